@@ -80,6 +80,10 @@ ALWAYS_INLINE void tlb_flush_for(void* virt) {
     __asm__ __volatile__ ( "invlpg [%0]" : : "r"(virt) : "memory" );
 }
 
+ALWAYS_INLINE void cpuid(uint32_t leaf, uint32_t* eax, uint32_t* ebx, uint32_t* ecx, uint32_t* edx) {
+    __asm__ __volatile__ ( "cpuid" : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx) : "a"(leaf), "c"(0) );
+}
+
 ALWAYS_INLINE void load_gdt(void* gdt, size_t size) {
     struct {
         uint16_t size;
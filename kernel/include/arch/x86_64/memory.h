@@ -14,9 +14,16 @@ typedef uint64_t page_entry_t;
 typedef page_entry_t pagetable_t[PAGETABLE_LENGTH];
 
 #define PAGE_SIZE 0x1000
+#define HUGE_PAGE_SIZE 0x00200000
+#define HUGE_PAGE_SIZE_1G 0x40000000
+
+// dynmem places each memory map entry at the same offset from this alignment as in physical memory
+#define DYNMEM_VIRT_ALIGN HUGE_PAGE_SIZE_1G
 
 #define DYNMEM_START_PHYS_MINIMUM   0x00800000
 #define DYNMEM_START_VIRT           0x00200000
+// the lower half above DYNMEM_START_VIRT
+#define DYNMEM_VIRT_SIZE            0x00007fffffe00000
 
 #define KERNEL_SIZE             0x00400000
 #define KERNEL_START_PHYS       0x00200000
@@ -25,6 +32,10 @@ typedef page_entry_t pagetable_t[PAGETABLE_LENGTH];
 #define KSTACK_SIZE             0x00200000
 #define KSTACK_START_VIRT       0xffffffff8f000000
 
+// every physical address is mapped at PHYSMAP_START_VIRT + phys
+#define PHYSMAP_VIRT_SIZE       0x0000008000000000
+#define PHYSMAP_START_VIRT      0xffff800000000000
+
 #define IOMAP_VIRT_SIZE         0x0000007f00000000
 #define IOMAP_START_VIRT        0xffffff8000000000
 
@@ -44,19 +55,27 @@ typedef page_entry_t pagetable_t[PAGETABLE_LENGTH];
 #define PAGE_FLAG_NIL 0
 #define KERNEL_PAGE_FLAG (PAGE_FLAG_PRESENT | PAGE_FLAG_WRITABLE)
 
-struct mmap;
+struct mmap_dyn_index;
 
 struct pagetable_construct_result {
     size_t dyn_total_len;
     size_t dyn_pagetable_len;
+    // leaf entries that map dynmem, by page size
+    size_t dyn_pages_1g;
+    size_t dyn_pages_2m;
+    size_t dyn_pages_4k;
 };
 
 const char* mmap_entry_type_str(mmap_entry_type type);
 
-struct pagetable_construct_result pagetable_construct(const struct mmap* mmap_dyn);
+struct pagetable_construct_result pagetable_construct(const struct mmap_dyn_index* mmap_dyn);
+
+// translation between dynmem and physical addresses by the entry that contains them, panics outside of entries
+uintptr_t mmap_dyn_virt_to_phys(const struct mmap_dyn_index* mmap_dyn, uintptr_t virt);
+uintptr_t mmap_dyn_phys_to_virt(const struct mmap_dyn_index* mmap_dyn, uintptr_t phys);
 
 // all addresses must be aligned by PAGE_SIZE
-void pagetable_mmio_map(uintptr_t begin_virt, uintptr_t end_virt, uintptr_t phys, page_entry_t flags, const struct mmap* mmap_dyn);
-void pagetable_mmio_unmap(uintptr_t begin_virt, uintptr_t end_virt, const struct mmap* mmap_dyn);
+void pagetable_mmio_map(uintptr_t begin_virt, uintptr_t end_virt, uintptr_t phys, page_entry_t flags, const struct mmap_dyn_index* mmap_dyn);
+void pagetable_mmio_unmap(uintptr_t begin_virt, uintptr_t end_virt);
 
-void pagetable_print_with_dyn(const struct mmap* mmap_dyn);
+void pagetable_print_all(void);
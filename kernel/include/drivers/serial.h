@@ -1,9 +1,16 @@
 #pragma once
 
+#include <stddef.h>
+
+// transmit FIFO of the 16550 uart, enabled by serial_init()
+#define SERIAL_FIFO_SIZE 16
+
 struct tty_device;
 
 void serial_init(void);
 void serial_putchar(char ch);
+// waits for an empty FIFO once per SERIAL_FIFO_SIZE bytes instead of once per byte
+void serial_write(const char* buf, size_t len);
 void serial_puts(const char* str);
 
 void serial_tty_device_init(struct tty_device* device);
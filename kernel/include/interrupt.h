@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -21,5 +22,8 @@ void interrupt_register_isr(uint8_t vector, void (*handler)());
 void interrupt_device_init(void);
 void interrupt_device_enable(void);
 
+// push from interrupt handlers, pop from the main loop without masking interrupts
 bool intr_queue_push(struct intr_msg* msg);
 bool intr_queue_try_pop(struct intr_msg* msg);
+size_t intr_queue_pop_n(struct intr_msg* msgs, size_t n);
+bool intr_queue_is_empty(void);
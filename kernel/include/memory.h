@@ -5,6 +5,7 @@
 #include <stdalign.h>
 #include <freec/inttypes.h>
 #include <buddy/slice.h>
+#include <buddy/buddy.h>
 #include <slab/slab.h>
 #include <collections/arraylist.h>
 
@@ -29,8 +30,22 @@ struct mmap {
     struct mmap_entry entries[];
 };
 
+// available entries of the dynamic memory map, sorted by base and laid out in this order in dynmem.
+// virt_offsets[i] is the offset of entries[i] from the start of dynmem, virt_offsets[len] is the end of the last.
+// every entry keeps its physical offset from DYNMEM_VIRT_ALIGN so that large pages can map them.
+struct mmap_dyn_index {
+    const struct mmap* mmap;
+    const mmap_ulong* virt_offsets;
+};
+
 extern struct slab_page_allocator g_slab_page_allocator;
-#define SLAB_INIT(slab, type) slab_init(slab, sizeof(type), alignof(type), &g_slab_page_allocator)
+#ifdef DEBUG
+#define SLAB_INIT_SIZED(slab, size, align) slab_init(slab, size, align, &g_slab_page_allocator)
+#else
+// release slabs do not zero objects
+#define SLAB_INIT_SIZED(slab, size, align) slab_init_release(slab, size, align, &g_slab_page_allocator)
+#endif
+#define SLAB_INIT(slab, type) SLAB_INIT_SIZED(slab, sizeof(type), alignof(type))
 
 extern struct arraylist_allocator g_arraylist_allocator;
 
@@ -39,11 +54,51 @@ void memory_init(void);
 volatile void* mmio_alloc_mapping(uintptr_t begin_phys, uintptr_t end_phys);
 void mmio_dealloc_mapping(uintptr_t begin_virt, uintptr_t end_virt);
 
-struct slice dynmem_alloc_nolock(size_t len);
+// dynmem allocation takes only the lock of a zone, so it can be used with mmio or page tables locked
 struct slice dynmem_alloc(size_t len);
-void dynmem_dealloc_nolock(void* ptr, size_t len);
 void dynmem_dealloc(void* ptr, size_t len);
 
+// page-rounded len without power-of-two rounding, and a free for any page-aligned part of allocated memory
+struct slice dynmem_alloc_exact(size_t len);
+void dynmem_dealloc_exact(void* ptr, size_t len);
+
+// aligned by align inside the dynmem virtual range [lo, hi), freed by dynmem_dealloc_exact()
+struct slice dynmem_alloc_constrained(size_t len, size_t align, uintptr_t lo, uintptr_t hi);
+
+// constant-offset translation within the memory map entry of the address, the same one the page tables use
+uintptr_t dynmem_virt_to_phys(const volatile void* ptr);
+void* dynmem_phys_to_virt(uintptr_t phys);
+
+// n blocks of (PAGE_SIZE << order) bytes each, returns the count allocated
+size_t dynmem_alloc_bulk(size_t order, size_t n, void** out);
+void dynmem_dealloc_bulk(size_t order, size_t n, void* const* ptrs);
+
+// 16-byte aligned, served by size-class slabs up to 2KiB and by dynmem above
+void* kmalloc(size_t size);
+void kfree(void* ptr);
+
+struct intrlock;
+
+// lock is the one the owner holds around calls on slab, or NULL
+void memory_register_slab(struct slab_allocator* slab, const char* name, struct intrlock* lock);
+
+struct memory_stats {
+    size_t zone_count;
+    size_t total;
+    size_t used;        // including the pages in per-cpu caches
+    size_t cached;
+    size_t free;
+    size_t free_blocks[BUDDY_STATS_LEVELS];
+    size_t largest_free;
+    uint32_t fragmentation;     // per mille, see buddy_stats
+    size_t slab_count;
+};
+
+void memory_get_stats(struct memory_stats* stats);
+// statistics of the index-th registered slab cache, false past the last one
+bool memory_get_slab_stats(size_t index, const char** name, struct slab_stats* stats);
+void memory_print_stats(void);
+
 void mmap_print_bootinfo(void);
 void mmap_print_dyn(void);
 void pagetable_print(void);
@@ -19,3 +19,15 @@ void serial_putchar(char ch) {
     while ((in8(0x3f8 + 5) & 0x20) == 0) {}
     out8(0x3f8, ch);
 }
+
+void serial_write(const char* buf, size_t len) {
+    while (len > 0) {
+        while ((in8(0x3f8 + 5) & 0x20) == 0) {}
+        const size_t n = len < SERIAL_FIFO_SIZE ? len : SERIAL_FIFO_SIZE;
+        for (size_t i = 0; i < n; i++) {
+            out8(0x3f8, buf[i]);
+        }
+        buf += n;
+        len -= n;
+    }
+}
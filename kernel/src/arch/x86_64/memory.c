@@ -1,6 +1,7 @@
 #include <stdbool.h>
 #include <stdalign.h>
 #include <freec/string.h>
+#include <freec/stdlib.h>
 #include <freec/assert.h>
 
 #include "memory.h"
@@ -33,48 +34,50 @@ static uintptr_t virt_to_phys_kernel(uintptr_t virt) {
     return virt - KERNEL_START_VIRT + KERNEL_START_PHYS;
 }
 
-static uintptr_t phys_to_virt_kernel(uintptr_t phys) {
-    return phys - KERNEL_START_PHYS + KERNEL_START_VIRT;
-}
-
-static uintptr_t virt_to_phys_dynmem(uintptr_t virt, const struct mmap* mmap_dyn) {
-    uintptr_t offset = virt - DYNMEM_START_VIRT;
-    uintptr_t sum = 0;
-    for (uint32_t i = 0; i < mmap_dyn->len; i++) {
-        const struct mmap_entry* entry = mmap_dyn->entries + i;
-        uintptr_t end_offset = sum + entry->length;
+uintptr_t mmap_dyn_virt_to_phys(const struct mmap_dyn_index* mmap_dyn, uintptr_t virt) {
+    const uint32_t len = mmap_dyn->mmap->len;
+    const uintptr_t offset = virt - DYNMEM_START_VIRT;
+    if (offset >= mmap_dyn->virt_offsets[len]) {
+        panic("dynmem: invalid virtual address");
+    }
 
-        if (offset < end_offset) {
-            return entry->base + (offset - sum);
+    // last entry whose virtual offset is not above offset
+    uint32_t lo = 0, hi = len;
+    while (hi - lo > 1) {
+        const uint32_t mid = lo + (hi - lo) / 2;
+        if (mmap_dyn->virt_offsets[mid] <= offset) {
+            lo = mid;
+        } else {
+            hi = mid;
         }
-
-        sum = end_offset;
     }
-    panic("dynmem: invalid virtual address");
+    if (offset - mmap_dyn->virt_offsets[lo] >= mmap_dyn->mmap->entries[lo].length) {
+        // between two entries
+        panic("dynmem: invalid virtual address");
+    }
+    return mmap_dyn->mmap->entries[lo].base + (offset - mmap_dyn->virt_offsets[lo]);
 }
 
-static uintptr_t phys_to_virt_dynmem(uintptr_t phys, const struct mmap* mmap_dyn) {
-    uintptr_t sum = 0;
-    for (uint32_t i = 0; i < mmap_dyn->len; i++) {
-        const struct mmap_entry* entry = mmap_dyn->entries + i;
-
-        if (entry->base <= phys && phys < entry->base + entry->length) {
-            return DYNMEM_START_VIRT + sum + (phys - entry->base);
+uintptr_t mmap_dyn_phys_to_virt(const struct mmap_dyn_index* mmap_dyn, uintptr_t phys) {
+    // last entry whose base is not above phys, entries are sorted by base
+    uint32_t lo = 0, hi = mmap_dyn->mmap->len;
+    while (hi - lo > 1) {
+        const uint32_t mid = lo + (hi - lo) / 2;
+        if (mmap_dyn->mmap->entries[mid].base <= phys) {
+            lo = mid;
+        } else {
+            hi = mid;
         }
-
-        sum += entry->length;
     }
-    panic("dynmem: invalid physical address");
-}
-
-static uintptr_t phys_to_virt(uintptr_t phys, const struct mmap* mmap_dyn) {
-    if (phys >= mmap_dyn->entries[0].base) {
-        return phys_to_virt_dynmem(phys, mmap_dyn);
-    } else if (KERNEL_START_PHYS <= phys && phys < KERNEL_START_PHYS + KERNEL_SIZE) {
-        return phys_to_virt_kernel(phys);
-    } else {
+    const struct mmap_entry* entry = &mmap_dyn->mmap->entries[lo];
+    if (phys < entry->base || phys - entry->base >= entry->length) {
         panic("dynmem: invalid physical address");
     }
+    return DYNMEM_START_VIRT + mmap_dyn->virt_offsets[lo] + (phys - entry->base);
+}
+
+static uintptr_t phys_to_virt(uintptr_t phys) {
+    return PHYSMAP_START_VIRT + phys;
 }
 
 static void pagetable_construct_kernel(void) {
@@ -88,8 +91,8 @@ static void pagetable_construct_kernel(void) {
     pagetable_set(virt_to_phys_kernel((uintptr_t)g_pagetable));
 }
 
-static void pagetable_construct_dyn_3(uintptr_t pdpt0_phys, uintptr_t pdt0_phys, uintptr_t pt0_phys) {
-    // map first 3 pages of dynmem for dynpage_factory
+static void pagetable_construct_dyn_3(uintptr_t virt, uintptr_t pdpt0_phys, uintptr_t pdt0_phys, uintptr_t pt0_phys) {
+    // map first 3 pages of dynmem at virt for dynpage_factory
 
     // temporarily map first 3 pages to PML4:1, PDPT:0, PDT:1, PT:[2,4] by recursive paging
     alignas(PAGE_SIZE) pagetable_t tmptable;
@@ -102,102 +105,181 @@ static void pagetable_construct_dyn_3(uintptr_t pdpt0_phys, uintptr_t pdt0_phys,
     tmptable[4] = pt0_phys | KERNEL_PAGE_FLAG;
     tlb_flush_all();
 
-    // construct geniune first 3 pages
+    // construct geniune first 3 pages, which construct_mmap_dyn keeps inside one page table
     pagetable_t* pdpt0 = (pagetable_t*)((page_entry_t)1 << 39 | (page_entry_t)1 << 21 | (page_entry_t)2 << 12);
     pagetable_t* pdt0 = pdpt0 + 1;
     pagetable_t* pt0 = pdpt0 + 2;
-    // DYNMEM_START_VIRT = PML4:0, PDPT:0, PDT:1, PT:0
+    const uint16_t pdpi = (virt >> 30) & 0x1ff, pdti = (virt >> 21) & 0x1ff, ptei = (virt >> 12) & 0x1ff;
+    assert((virt >> 39) == 0 && ptei + 3 <= PAGETABLE_LENGTH, "dynmem: first page tables out of bound");
     g_pagetable[0] = pdpt0_phys | KERNEL_PAGE_FLAG;
-    (*pdpt0)[0] = pdt0_phys | KERNEL_PAGE_FLAG;
-    (*pdt0)[1] = pt0_phys | KERNEL_PAGE_FLAG;
-    (*pt0)[0] = pdpt0_phys | KERNEL_PAGE_FLAG;
-    (*pt0)[1] = pdt0_phys | KERNEL_PAGE_FLAG;
-    (*pt0)[2] = pt0_phys | KERNEL_PAGE_FLAG;
+    (*pdpt0)[pdpi] = pdt0_phys | KERNEL_PAGE_FLAG;
+    (*pdt0)[pdti] = pt0_phys | KERNEL_PAGE_FLAG;
+    (*pt0)[ptei] = pdpt0_phys | KERNEL_PAGE_FLAG;
+    (*pt0)[ptei + 1] = pdt0_phys | KERNEL_PAGE_FLAG;
+    (*pt0)[ptei + 2] = pt0_phys | KERNEL_PAGE_FLAG;
 
     // remove temporary page
     g_pagetable[1] = 0;
 }
 
+// index shift of each level of page tables, from PML4 to PT
+static const unsigned g_level_shifts[4] = { 39, 30, 21, 12 };
+
 struct dynpage_factory {
     pagetable_t* next_table;
     pagetable_t* tables[4];
+    uintptr_t table_bases[4];   // virtual address >> (shift of the upper level) of the range mapped by tables[level]
+    uintptr_t table_limit;      // tables must be taken from mapped memory of the first entry
     uintptr_t first_3[3];
-    uint16_t next_indices[4];
     uint32_t metapage_count;
     uint32_t first_3_index;
+    size_t leaf_counts[4];
 };
 
-static struct dynpage_factory dynpage_factory_create(void) {
-    pagetable_t* pdpt0 = (pagetable_t*)DYNMEM_START_VIRT;
+static struct dynpage_factory dynpage_factory_create(const struct mmap_dyn_index* mmap_dyn) {
+    // the first entry starts at its own offset from DYNMEM_VIRT_ALIGN, like the others
+    const uintptr_t first_virt = DYNMEM_START_VIRT + mmap_dyn->virt_offsets[0];
+    pagetable_t* pdpt0 = (pagetable_t*)first_virt;
     return (struct dynpage_factory){
         .next_table = pdpt0 + 3,
+        // pagetable_construct_dyn_3 maps the page tables of first_virt and its first 3 pages
         .tables = { &g_pagetable, pdpt0, pdpt0 + 1, pdpt0 + 2 },
+        .table_bases = { 0, first_virt >> 39, first_virt >> 30, first_virt >> 21 },
+        .table_limit = first_virt + mmap_dyn->mmap->entries[0].length,
         .first_3 = { 0 },
-        // pagetable_construct_dyn_3 maps PML4:0, PDPT:0, PDT:1, PT:[0,2]
-        // thus next_indices is set by [1, 1, 2, 3]
-        .next_indices = { 1, 1, 2, 3 },
         .metapage_count = 0,
         .first_3_index = 0,
+        .leaf_counts = { 0 },
     };
 }
 
-static void dynpage_factory_next_recur(struct dynpage_factory* factory,
-    uint32_t level, uintptr_t addr_phys, const struct mmap* mmap_dyn
+static pagetable_t* dynpage_factory_take(struct dynpage_factory* factory) {
+    // the next page after the dynmem page tables, which is already mapped
+    pagetable_t* t = factory->next_table++;
+    assert((uintptr_t)factory->next_table <= factory->table_limit, "dynpage_factory_take() out of bound");
+    factory->metapage_count++;
+    memset(t, 0, sizeof(pagetable_t));
+    return t;
+}
+
+// map virt to phys by a page of the level, 3 for PT, 2 for 2MiB and 1 for 1GiB pages
+static void dynpage_factory_map(struct dynpage_factory* factory,
+    uintptr_t virt, uintptr_t phys, uint32_t leaf_level, const struct mmap_dyn_index* mmap_dyn
 ) {
-    assert(!(level == 0 && factory->next_indices[level] >= 256), "dynpage_factory_next_recur() out of bound");
-
-    if (factory->next_indices[level] >= PAGETABLE_LENGTH) {
-        pagetable_t* next = factory->next_table;
-        memset(next, 0, sizeof(pagetable_t));
-        factory->tables[level] = next;
-        factory->next_indices[level] = 0;
-        factory->next_table++;
-        factory->metapage_count++;
-
-        uint32_t next_phys = virt_to_phys_dynmem((uintptr_t)next, mmap_dyn);
-        dynpage_factory_next_recur(factory, level - 1, next_phys, mmap_dyn);
+    assert((virt >> g_level_shifts[0]) < 256, "dynpage_factory_map() out of bound");
+
+    for (uint32_t level = 1; level <= leaf_level; level++) {
+        const uintptr_t base = virt >> g_level_shifts[level - 1];
+        if (factory->table_bases[level] != base) {
+            pagetable_t* t = dynpage_factory_take(factory);
+            const uint16_t index = (virt >> g_level_shifts[level - 1]) & 0x1ff;
+            (*factory->tables[level - 1])[index] = mmap_dyn_virt_to_phys(mmap_dyn, (uintptr_t)t) | KERNEL_PAGE_FLAG;
+            factory->tables[level] = t;
+            factory->table_bases[level] = base;
+        }
     }
 
-    (*factory->tables[level])[factory->next_indices[level]] = addr_phys | KERNEL_PAGE_FLAG;
-    factory->next_indices[level]++;
+    const uint16_t index = (virt >> g_level_shifts[leaf_level]) & 0x1ff;
+    const page_entry_t huge = leaf_level != 3 ? PAGE_FLAG_HUGE : 0;
+    (*factory->tables[leaf_level])[index] = phys | huge | KERNEL_PAGE_FLAG;
+    factory->leaf_counts[leaf_level]++;
 }
 
 static void dynpage_factory_next(struct dynpage_factory* factory,
-    uintptr_t addr_phys, const struct mmap* mmap_dyn
+    uintptr_t virt, uintptr_t phys, uint32_t leaf_level, const struct mmap_dyn_index* mmap_dyn
 ) {
     if (factory->first_3_index < 3) {
-        factory->first_3[factory->first_3_index] = addr_phys;
+        factory->first_3[factory->first_3_index] = phys;
         if (++factory->first_3_index == 3) {
-            pagetable_construct_dyn_3(factory->first_3[0], factory->first_3[1], factory->first_3[2]);
+            // tables[1] is still the first page of dynmem
+            pagetable_construct_dyn_3((uintptr_t)factory->tables[1], factory->first_3[0], factory->first_3[1], factory->first_3[2]);
             factory->metapage_count = 3;
+            factory->leaf_counts[3] = 3;
         }
     } else {
-        dynpage_factory_next_recur(factory, 3, addr_phys, mmap_dyn);
+        dynpage_factory_map(factory, virt, phys, leaf_level, mmap_dyn);
+    }
+}
+
+static bool cpu_has_1g_pages(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(0x80000000, &eax, &ebx, &ecx, &edx);
+    if (eax < 0x80000001) {
+        return false;
     }
+    cpuid(0x80000001, &eax, &ebx, &ecx, &edx);
+    return (edx & ((uint32_t)1 << 26)) != 0;
 }
 
-static struct pagetable_construct_result pagetable_construct_dyn(const struct mmap* mmap_dyn) {
-    struct dynpage_factory factory = dynpage_factory_create();
-    size_t pages = 0;
+// map physical memory up to the end of RAM at PHYSMAP_START_VIRT by 1GiB pages, or 2MiB pages without them.
+// holes are mapped too; MTRRs keep their memory types.
+static void pagetable_construct_physmap(struct dynpage_factory* factory, const struct mmap_dyn_index* mmap_dyn) {
+    const struct mmap_entry* last = &mmap_dyn->mmap->entries[mmap_dyn->mmap->len - 1];
+    const uintptr_t end = MAX(last->base + last->length, KSTACK_START_PHYS + KSTACK_SIZE);
+    assert(end <= PHYSMAP_VIRT_SIZE, "physical memory is larger than the direct map");
+
+    pagetable_t* pdpt = dynpage_factory_take(factory);
+    g_pagetable[(PHYSMAP_START_VIRT >> 39) & 0x1ff] = mmap_dyn_virt_to_phys(mmap_dyn, (uintptr_t)pdpt) | KERNEL_PAGE_FLAG;
+
+    const bool has_1g = cpu_has_1g_pages();
+    for (uintptr_t phys = 0; phys < end; phys += HUGE_PAGE_SIZE_1G) {
+        const size_t pdpi = phys / HUGE_PAGE_SIZE_1G;
+        if (has_1g) {
+            (*pdpt)[pdpi] = phys | PAGE_FLAG_HUGE | KERNEL_PAGE_FLAG;
+            continue;
+        }
 
-    for (size_t i = 0; i < mmap_dyn->len; i++) {
-        const struct mmap_entry* entry = mmap_dyn->entries + i;
-        for (uintptr_t addr_phys = entry->base;
-            addr_phys < entry->base + entry->length;
-            addr_phys += PAGE_SIZE
-        ) {
-            dynpage_factory_next(&factory, addr_phys, mmap_dyn);
-            pages++;
+        pagetable_t* pdt = dynpage_factory_take(factory);
+        (*pdpt)[pdpi] = mmap_dyn_virt_to_phys(mmap_dyn, (uintptr_t)pdt) | KERNEL_PAGE_FLAG;
+        for (size_t pdti = 0; pdti < PAGETABLE_LENGTH; pdti++) {
+            (*pdt)[pdti] = (phys + pdti * HUGE_PAGE_SIZE) | PAGE_FLAG_HUGE | KERNEL_PAGE_FLAG;
+        }
+    }
+}
+
+static struct pagetable_construct_result pagetable_construct_dyn(const struct mmap_dyn_index* mmap_dyn) {
+    struct dynpage_factory factory = dynpage_factory_create(mmap_dyn);
+    const bool has_1g = cpu_has_1g_pages();
+    size_t total_len = 0;
+
+    for (size_t i = 0; i < mmap_dyn->mmap->len; i++) {
+        const struct mmap_entry* entry = mmap_dyn->mmap->entries + i;
+        const uintptr_t end = entry->base + entry->length;
+        uintptr_t virt = DYNMEM_START_VIRT + mmap_dyn->virt_offsets[i];
+
+        for (uintptr_t phys = entry->base; phys < end; ) {
+            // the largest page that both addresses are aligned by and the entry has room for,
+            // except the first 3 pages which become the first page tables
+            uint32_t level = 3;
+            uintptr_t size = PAGE_SIZE;
+            const bool bootstrapped = factory.first_3_index == 3;
+            if (bootstrapped && has_1g && (virt | phys) % HUGE_PAGE_SIZE_1G == 0 && end - phys >= HUGE_PAGE_SIZE_1G) {
+                level = 1;
+                size = HUGE_PAGE_SIZE_1G;
+            } else if (bootstrapped && (virt | phys) % HUGE_PAGE_SIZE == 0 && end - phys >= HUGE_PAGE_SIZE) {
+                level = 2;
+                size = HUGE_PAGE_SIZE;
+            }
+
+            dynpage_factory_next(&factory, virt, phys, level, mmap_dyn);
+            virt += size;
+            phys += size;
         }
+        total_len += entry->length;
     }
 
+    pagetable_construct_physmap(&factory, mmap_dyn);
+
     return (struct pagetable_construct_result){
-        .dyn_total_len = pages * PAGE_SIZE,
+        .dyn_total_len = total_len,
         .dyn_pagetable_len = factory.metapage_count * PAGE_SIZE,
+        .dyn_pages_1g = factory.leaf_counts[1],
+        .dyn_pages_2m = factory.leaf_counts[2],
+        .dyn_pages_4k = factory.leaf_counts[3],
     };
 }
 
-struct pagetable_construct_result pagetable_construct(const struct mmap* mmap_dyn) {
+struct pagetable_construct_result pagetable_construct(const struct mmap_dyn_index* mmap_dyn) {
     pagetable_construct_kernel();
     struct pagetable_construct_result result = pagetable_construct_dyn(mmap_dyn);
     tlb_flush_all();
@@ -240,20 +322,20 @@ static struct page_iterator page_iterator_next(struct page_iterator it) {
     return page_iterator_next_pdti(it);
 }
 
-static pagetable_t* page_get_or_alloc(pagetable_t* upper, uint16_t index, page_entry_t flags, const struct mmap* mmap_dyn) {
+static pagetable_t* page_get_or_alloc(pagetable_t* upper, uint16_t index, page_entry_t flags, const struct mmap_dyn_index* mmap_dyn) {
     if ((*upper)[index] & PAGE_FLAG_PRESENT) {
-        return (pagetable_t*)phys_to_virt((*upper)[index] & PAGE_MASK_ADDR, mmap_dyn);
+        return (pagetable_t*)phys_to_virt((*upper)[index] & PAGE_MASK_ADDR);
     } else {
-        pagetable_t* t = dynmem_alloc_nolock(PAGE_SIZE).ptr;
+        pagetable_t* t = dynmem_alloc(PAGE_SIZE).ptr;
         memset(t, 0, PAGE_SIZE);
-        (*upper)[index] = (page_entry_t)virt_to_phys_dynmem((uintptr_t)t, mmap_dyn) | flags;
+        (*upper)[index] = (page_entry_t)mmap_dyn_virt_to_phys(mmap_dyn, (uintptr_t)t) | flags;
         return t;
     }
 }
 
-static pagetable_t* page_get_assert(pagetable_t* upper, uint16_t index, const struct mmap* mmap_dyn) {
+static pagetable_t* page_get_assert(pagetable_t* upper, uint16_t index) {
     assert((*upper)[index] & PAGE_FLAG_PRESENT);
-    return (pagetable_t*)phys_to_virt((*upper)[index] & PAGE_MASK_ADDR, mmap_dyn);
+    return (pagetable_t*)phys_to_virt((*upper)[index] & PAGE_MASK_ADDR);
 }
 
 static bool pagetable_is_empty(pagetable_t* table) {
@@ -265,10 +347,58 @@ static bool pagetable_is_empty(pagetable_t* table) {
     return true;
 }
 
+// invalidations of one map/unmap, done together at the end.
+// past TLB_BATCH_PAGES pages one full flush is cheaper than invlpg for each.
+#define TLB_BATCH_PAGES 32
+#define TLB_BATCH_TABLES 16
+
+struct tlb_batch {
+    uintptr_t pages[TLB_BATCH_PAGES];
+    pagetable_t* tables[TLB_BATCH_TABLES];  // freed after the flush, as they may still be cached
+    uint32_t page_count;
+    uint32_t table_count;
+    bool flush_all;
+};
+
+static void tlb_batch_flush(struct tlb_batch* batch) {
+    // this is where a shootdown to the other CPUs goes once they are online
+    if (batch->flush_all) {
+        tlb_flush_all();
+    } else {
+        for (uint32_t i = 0; i < batch->page_count; i++) {
+            tlb_flush_for((void*)batch->pages[i]);
+        }
+    }
+
+    for (uint32_t i = 0; i < batch->table_count; i++) {
+        dynmem_dealloc(batch->tables[i], PAGE_SIZE);
+    }
+
+    batch->page_count = 0;
+    batch->table_count = 0;
+    batch->flush_all = false;
+}
+
+static void tlb_batch_page(struct tlb_batch* batch, uintptr_t virt) {
+    if (batch->page_count < TLB_BATCH_PAGES) {
+        batch->pages[batch->page_count++] = virt;
+    } else {
+        batch->flush_all = true;
+    }
+}
+
+static void tlb_batch_table(struct tlb_batch* batch, pagetable_t* table) {
+    if (batch->table_count == TLB_BATCH_TABLES) {
+        tlb_batch_flush(batch);
+    }
+    batch->tables[batch->table_count++] = table;
+}
+
 // TODO: unit tests for pagetable_mmio_*
-void pagetable_mmio_map(uintptr_t begin_virt, uintptr_t end_virt, uintptr_t phys, page_entry_t flags, const struct mmap* mmap_dyn) {
+void pagetable_mmio_map(uintptr_t begin_virt, uintptr_t end_virt, uintptr_t phys, page_entry_t flags, const struct mmap_dyn_index* mmap_dyn) {
     assert(flags & PAGE_FLAG_PRESENT);
 
+    struct tlb_batch batch = { .page_count = 0, .table_count = 0, .flush_all = false };
     struct page_iterator it = page_iterator_from_virt(begin_virt);
     for (uintptr_t offset = 0; begin_virt + offset < end_virt; ) {
         pagetable_t* pdpt = page_get_or_alloc(&g_pagetable, it.pl4i, flags, mmap_dyn);
@@ -278,7 +408,7 @@ void pagetable_mmio_map(uintptr_t begin_virt, uintptr_t end_virt, uintptr_t phys
             && end_virt - begin_virt - offset >= 0x00200000
         ) {
             (*pdt)[it.pdti] = (phys + offset) | flags | PAGE_FLAG_HUGE;
-            tlb_flush_for((void*)(begin_virt + offset));
+            tlb_batch_page(&batch, begin_virt + offset);
 
             offset += 0x00200000;
             it = page_iterator_next_pdti(it);
@@ -286,21 +416,24 @@ void pagetable_mmio_map(uintptr_t begin_virt, uintptr_t end_virt, uintptr_t phys
             pagetable_t* pt = page_get_or_alloc(pdt, it.pdti, flags, mmap_dyn);
             assert(!((*pt)[it.ptei] & PAGE_FLAG_PRESENT));
             (*pt)[it.ptei] = (phys + offset) | flags;
-            tlb_flush_for((void*)(begin_virt + offset));
+            tlb_batch_page(&batch, begin_virt + offset);
 
             offset += PAGE_SIZE;
             it = page_iterator_next(it);
         }
     }
+
+    tlb_batch_flush(&batch);
 }
 
-void pagetable_mmio_unmap(uintptr_t begin_virt, uintptr_t end_virt, const struct mmap* mmap_dyn) {
+void pagetable_mmio_unmap(uintptr_t begin_virt, uintptr_t end_virt) {
+    struct tlb_batch batch = { .page_count = 0, .table_count = 0, .flush_all = false };
     struct page_iterator it = page_iterator_from_virt(begin_virt);
     struct page_iterator next;
     uintptr_t step;
     for (uintptr_t offset = 0; begin_virt + offset < end_virt; offset += step, it = next) {
-        pagetable_t* pdpt = page_get_assert(&g_pagetable, it.pl4i, mmap_dyn);
-        pagetable_t* pdt = page_get_assert(pdpt, it.pdpi, mmap_dyn);
+        pagetable_t* pdpt = page_get_assert(&g_pagetable, it.pl4i);
+        pagetable_t* pdt = page_get_assert(pdpt, it.pdpi);
         pagetable_t* pt = NULL;
 
         assert((*pdt)[it.pdti] & PAGE_FLAG_PRESENT);
@@ -310,27 +443,29 @@ void pagetable_mmio_unmap(uintptr_t begin_virt, uintptr_t end_virt, const struct
             step = 0x00200000;
             next = page_iterator_next_pdti(it);
         } else {
-            pt = page_get_assert(pdt, it.pdti, mmap_dyn);
+            pt = page_get_assert(pdt, it.pdti);
             (*pt)[it.ptei] = 0;
             step = PAGE_SIZE;
             next = page_iterator_next(it);
         }
 
-        tlb_flush_for((void*)(begin_virt + offset));
+        tlb_batch_page(&batch, begin_virt + offset);
 
         if (it.ptei > next.ptei && pagetable_is_empty(pt)) {
-            dynmem_dealloc_nolock(pt, PAGE_SIZE);
+            tlb_batch_table(&batch, pt);
             (*pdt)[it.pdti] = 0;
         }
         if (it.pdti > next.pdti && pagetable_is_empty(pdt)) {
-            dynmem_dealloc_nolock(pdt, PAGE_SIZE);
+            tlb_batch_table(&batch, pdt);
             (*pdpt)[it.pdpi] = 0;
         }
         if (it.pdpi > next.pdpi && pagetable_is_empty(pdpt)) {
-            dynmem_dealloc_nolock(pdpt, PAGE_SIZE);
+            tlb_batch_table(&batch, pdpt);
             g_pagetable[it.pl4i] = 0;
         }
     }
+
+    tlb_batch_flush(&batch);
 }
 
 #include <freec/inttypes.h>
@@ -360,7 +495,7 @@ static void print_page_flags(page_entry_t entry) {
     }
 }
 
-static void pagetable_print_recur(pagetable_t* table, const struct mmap* mmap_dyn,
+static void pagetable_print_recur(pagetable_t* table,
     const char* names[], unsigned depth, uintptr_t pagesize, uintptr_t virt
 ) {
     int leaf_begin = -1;
@@ -400,12 +535,12 @@ static void pagetable_print_recur(pagetable_t* table, const struct mmap* mmap_dy
         print_page_flags(entry);
         tty0_printf("\n");
 
-        pagetable_t* subtable = (pagetable_t*)phys_to_virt(phys, mmap_dyn);
-        pagetable_print_recur(subtable, mmap_dyn, names, depth + 1, pagesize >> 9, virt << 9 | idx);
+        pagetable_t* subtable = (pagetable_t*)phys_to_virt(phys);
+        pagetable_print_recur(subtable, names, depth + 1, pagesize >> 9, virt << 9 | idx);
     }
 }
 
-void pagetable_print_with_dyn(const struct mmap* mmap_dyn) {
+void pagetable_print_all(void) {
     const char* names[] = { "PML4E", " PDPE", "  PDE", "   PT" };
-    pagetable_print_recur(&g_pagetable, mmap_dyn, names, 0, 0x0000008000000000, 0);
+    pagetable_print_recur(&g_pagetable, names, 0, 0x0000008000000000, 0);
 }
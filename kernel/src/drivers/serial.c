@@ -1,13 +1,16 @@
 #include <stddef.h>
 #include <stdarg.h>
 #include <freec/stdio.h>
+#include <freec/string.h>
 
 #include "drivers/serial.h"
 #include "tty.h"
 
 void serial_puts(const char* str) {
     while (*str) {
-        serial_putchar(*str++);
+        const size_t len = strnlen(str, SERIAL_FIFO_SIZE);
+        serial_write(str, len);
+        str += len;
     }
 }
 
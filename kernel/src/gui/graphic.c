@@ -14,6 +14,8 @@ static struct slab_allocator g_slab_rects;
 
 void graphic_init(void) {
     SLAB_INIT(&g_slab_rects, struct rect);
+    slab_set_empty_max(&g_slab_rects, 1);
+    memory_register_slab(&g_slab_rects, "rect", NULL);
 }
 
 void graphic_from_fb(struct graphic* g) {
@@ -28,7 +30,7 @@ void graphic_from_fb(struct graphic* g) {
 
 void graphic_create_memory(struct graphic* g) {
     const struct fb_info* fi = fb_info_get();
-    struct slice mem = dynmem_alloc(fi->width * fi->height * sizeof(color_t));
+    struct slice mem = dynmem_alloc_exact(fi->width * fi->height * sizeof(color_t));
     assert(mem.ptr);
 
     g->framebuffer = mem.ptr;
@@ -40,7 +42,7 @@ void graphic_create_memory(struct graphic* g) {
 }
 
 void graphic_destroy_memory(struct graphic* g) {
-    dynmem_dealloc(g->framebuffer, g->pitch * g->height * sizeof(color_t));
+    dynmem_dealloc_exact(g->framebuffer, g->pitch * g->height * sizeof(color_t));
 }
 
 void graphic_set_offset(struct graphic* g, const struct rect* rt) {
@@ -10,10 +10,14 @@
 struct winman g_winman;
 
 static void draw_mouse(struct graphic* g, int x, int y);
+static void window_ctor(void* obj, void* ctx);
 
 void gui_init(void) {
     intrlock_init(&g_winman.lock);
     SLAB_INIT(&g_winman.slab_window, struct window);
+    slab_set_ctor(&g_winman.slab_window, window_ctor, NULL, NULL);
+    slab_set_empty_max(&g_winman.slab_window, 1);
+    memory_register_slab(&g_winman.slab_window, "window", &g_winman.lock);
 
     graphic_create_memory(&g_winman.backbuffer);
     g_winman.painting = false;
@@ -40,17 +44,23 @@ static void invalidate_window_all(struct window* w) {
     w->win_invalidated = (struct rect){ 0, 0, w->scr_rect.width, w->scr_rect.height };
 }
 
-struct window* window_new(void) {
-    intrlock_acquire(&g_winman.lock);
-
-    struct window* w = slab_alloc(&g_winman.slab_window);
+// default state of a new window, set once when the slab populates a page.
+// windows are never freed yet; a free has to restore this state before slab_dealloc
+static void window_ctor(void* obj, void* ctx) {
+    struct window* w = obj;
     w->title = "New Window";
     w->scr_rect = (struct rect){ 120, 120, 640, 480 };
     w->bg_color = 0xffffff;
     w->moving = false;
     w->proc = NULL;
+    w->data = NULL;
     invalidate_window_all(w);
+}
 
+struct window* window_new(void) {
+    intrlock_acquire(&g_winman.lock);
+
+    struct window* w = slab_alloc(&g_winman.slab_window);
     linkedlist_push_back(&g_winman.window_list, &w->link);
 
     intrlock_release(&g_winman.lock);
@@ -1,31 +1,31 @@
-#include <collections/ringbuffer.h>
+#include <collections/spsc_ringbuffer.h>
 
 #include "interrupt.h"
 
 #define INTR_QUEUE_SIZE 4096
 
+// interrupt handlers are the only producer (they do not nest) and the main loop the only consumer
 static struct intr_msg g_msg_buffer[INTR_QUEUE_SIZE];
-static struct ringbuffer g_intr_queue;
+static struct spsc_ringbuffer g_intr_queue;
 
 void interrupt_init(void) {
     descriptor_init();
 
-    ringbuffer_init(&g_intr_queue, g_msg_buffer, INTR_QUEUE_SIZE);
+    spsc_ringbuffer_init(&g_intr_queue, g_msg_buffer, sizeof(struct intr_msg), INTR_QUEUE_SIZE);
 }
 
 bool intr_queue_push(struct intr_msg* msg) {
-    if (ringbuffer_is_full(&g_intr_queue)) {
-        return false;
-    }
-    ringbuffer_push(&g_intr_queue, struct intr_msg, *msg);
-    return true;
+    return spsc_ringbuffer_push(&g_intr_queue, msg);
 }
 
 bool intr_queue_try_pop(struct intr_msg* msg) {
-    if (ringbuffer_is_empty(&g_intr_queue)) {
-        return false;
-    }
-    *msg = ringbuffer_pop(&g_intr_queue, struct intr_msg);
+    return spsc_ringbuffer_pop(&g_intr_queue, msg);
+}
+
+size_t intr_queue_pop_n(struct intr_msg* msgs, size_t n) {
+    return spsc_ringbuffer_pop_n(&g_intr_queue, msgs, n);
+}
 
-    return true;
+bool intr_queue_is_empty(void) {
+    return spsc_ringbuffer_is_empty(&g_intr_queue);
 }
@@ -47,22 +47,29 @@ void kmain(void) {
     mmap_print_dyn();
     //pagetable_print();
     dynmem_print();
+    memory_print_stats();
 
     gui_draw_all();
 
-    struct intr_msg msg;
+    struct intr_msg msgs[16];
     while (1) {
         interrupt_enable_and_wait();
 
         while (1) {
+            size_t count;
+            while ((count = intr_queue_pop_n(msgs, sizeof(msgs) / sizeof(msgs[0]))) > 0) {
+                for (size_t i = 0; i < count; i++) {
+                    dispatch_intr_msg(&msgs[i]);
+                }
+            }
+
+            // recheck with interrupts masked, so a message queued after it wakes the hlt above
             interrupt_disable();
             compiler_barrier();
-            if (!intr_queue_try_pop(&msg)) {
+            if (intr_queue_is_empty()) {
                 break;
             }
-
             interrupt_enable();
-            dispatch_intr_msg(&msg);
         }
 
         gui_draw_all();
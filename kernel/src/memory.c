@@ -3,13 +3,15 @@
 #include <freec/string.h>
 #include <freec/assert.h>
 #include <buddy/buddy.h>
+#include <buddy/range.h>
 #include <slab/slab.h>
-#include <collections/singlylist.h>
+#include <slab/magazine.h>
 
 #include "memory.h"
 #include "boot.h"
 #include "spinlock.h"
 #include "tty.h"
+#include "arch/inst.h"
 
 #if PAGE_SIZE != BUDDY_UNIT || PAGE_SIZE != SLAB_PAGE
 #error PAGE_SIZE must be equal to BUDDY_UNIT and SLAB_PAGE
@@ -24,34 +26,132 @@ union mmap_buffer {
     struct mmap mmap;
 };
 
-struct mmio_free_node {
-    struct singlylist_link link;
-    uintptr_t begin; // zero if invalid
-    uintptr_t end;
+// per-CPU caches of order-0 and order-1 pages in front of the buddy allocator
+#define PAGE_CACHE_CPUS 1
+#define PAGE_CACHE_ORDERS 2
+#define PAGE_CACHE_CAPACITY 64
+
+static const uint32_t g_page_cache_capacity[PAGE_CACHE_ORDERS] = { 64, 16 };
+static const uint32_t g_page_cache_batch[PAGE_CACHE_ORDERS] = { 32, 8 };
+
+struct page_cache {
+    void* pages[PAGE_CACHE_CAPACITY];
+    uint32_t count;
+    uint64_t hits;
+    uint64_t misses;
 };
 
-struct mmio_freelist {
-    struct singlylist list;
-    struct mmio_free_node nodes[24];
+struct cpu_page_cache {
+    // set while this CPU is inside its cache, so that a nested caller (e.g. from an interrupt)
+    // falls back to the locked path instead of disabling interrupts around every access
+    volatile bool busy;
+    struct page_cache orders[PAGE_CACHE_ORDERS];
 };
 
-struct meminfo {
+// one buddy allocator per physically contiguous range of dynmem
+#define DYNMEM_ZONE_MAX BOOTINFO_MMAP_MAXLEN
+#define DYNMEM_ZONE_MIN_LEN (PAGE_SIZE * 16)
+// buddy blocks are aligned relative to the data start of their zone, which is aligned by this,
+// so blocks up to the largest slab page are aligned by their size
+#define DYNMEM_DATA_ALIGN ((uintptr_t)SLAB_PAGE << SLAB_MAX_ORDER)
+
+struct dynmem_zone {
     struct intrlock lock;
-    struct mmio_freelist mmio_freelist;
     struct buddy_blocks buddy;
+    // [virt_begin, virt_end) maps to physical memory from phys_begin with a constant offset
+    uintptr_t virt_begin;
+    uintptr_t virt_end;
+    uintptr_t phys_begin;
+    // per buddy unit, 1 + the order of the slab page that covers it, or 0 outside of slab pages
+    uint8_t* slab_orders;
+};
+
+// kmalloc size classes up to KMALLOC_SMALL_MAX, larger requests go to dynmem
+#define KMALLOC_CLASSES 14
+#define KMALLOC_ALIGN 16
+#define KMALLOC_SMALL_MAX 2048
+
+static const uint16_t g_kmalloc_sizes[KMALLOC_CLASSES] = {
+    16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048,
+};
+
+static const char* const g_kmalloc_names[KMALLOC_CLASSES] = {
+    "kmalloc-16", "kmalloc-32", "kmalloc-48", "kmalloc-64", "kmalloc-96", "kmalloc-128", "kmalloc-192",
+    "kmalloc-256", "kmalloc-384", "kmalloc-512", "kmalloc-768", "kmalloc-1024", "kmalloc-1536", "kmalloc-2048",
+};
+
+// kmalloc magazines are per CPU like the page caches
+#define KMALLOC_CPUS PAGE_CACHE_CPUS
+
+// cache takes lock only to reach the depot and slab; busy guards cpus against reentry from interrupts
+struct kmalloc_class {
+    struct intrlock lock;
+    struct slab_allocator slab;
+    struct slab_cache cache;
+    struct slab_cpu_cache cpus[KMALLOC_CPUS];
+    volatile bool busy[KMALLOC_CPUS];
+};
+
+// in front of a large allocation, whose pages are not slab pages
+struct kmalloc_large {
+    alignas(KMALLOC_ALIGN) size_t len;
+};
+
+// slab caches reported by memory_print_stats()
+#define SLAB_REGISTRY_MAX 32
+
+struct slab_registration {
+    const char* name;
+    struct slab_allocator* slab;
+    struct intrlock* lock;  // held by the owner around slab calls, or NULL
+};
+
+struct meminfo {
+    struct intrlock lock;   // mmio space and page tables, dynmem zones have their own locks
+    struct cpu_page_cache page_caches[PAGE_CACHE_CPUS];
+    struct range_allocator mmio_space;       // free virtual ranges of the iomap window
+    struct slab_allocator mmio_range_slab;
+    struct dynmem_zone zones[DYNMEM_ZONE_MAX];
+    size_t zone_count;
     size_t dyn_total_len;
     size_t dyn_pagetable_len;
+    size_t dyn_pages[3];    // leaf entries mapping dynmem: 1GiB, 2MiB, 4KiB
+    struct kmalloc_class kmalloc_classes[KMALLOC_CLASSES];
+    uint8_t kmalloc_index[KMALLOC_SMALL_MAX / KMALLOC_ALIGN + 1];  // size class by size in KMALLOC_ALIGN units
+    struct slab_registration slabs[SLAB_REGISTRY_MAX];
+    size_t slab_count;
 };
 
 static union mmap_buffer g_mmap_dyn;
+static mmap_ulong g_mmap_dyn_offsets[BOOTINFO_MMAP_MAXLEN + 1];
+static const struct mmap_dyn_index g_mmap_dyn_index = { &g_mmap_dyn.mmap, g_mmap_dyn_offsets };
 static struct meminfo g_meminfo;
 
-static void* slab_page_alloc(void* ctx) {
-    return dynmem_alloc(SLAB_PAGE).ptr;
+static struct dynmem_zone* zone_of_virt(uintptr_t virt);
+
+static uint8_t* zone_slab_order(struct dynmem_zone* zone, uintptr_t virt) {
+    const uintptr_t data_addr = zone->buddy.start_addr + zone->buddy.data_offset;
+    return &zone->slab_orders[(virt - data_addr) / PAGE_SIZE];
+}
+
+static void* slab_page_alloc(void* ctx, size_t order) {
+    // zone data is aligned by DYNMEM_DATA_ALIGN, so a buddy block of a slab page is aligned by its size
+    void* page = dynmem_alloc((size_t)SLAB_PAGE << order).ptr;
+    if (page) {
+        memset(zone_slab_order(zone_of_virt((uintptr_t)page), (uintptr_t)page), (int)order + 1, (size_t)1 << order);
+    }
+    return page;
+}
+
+static void slab_page_dealloc(void* ctx, void* page, size_t order) {
+    memset(zone_slab_order(zone_of_virt((uintptr_t)page), (uintptr_t)page), 0, (size_t)1 << order);
+    dynmem_dealloc(page, (size_t)SLAB_PAGE << order);
 }
 
-static void slab_page_dealloc(void* ctx, void* page) {
-    dynmem_dealloc(page, SLAB_PAGE);
+// the slab whose page holds ptr, or NULL if ptr is not in a slab page
+static struct slab_allocator* dynmem_slab_of(const void* ptr) {
+    const uint8_t tag = *zone_slab_order(zone_of_virt((uintptr_t)ptr), (uintptr_t)ptr);
+    return tag != 0 ? slab_of(ptr, tag - 1u) : NULL;
 }
 
 struct slab_page_allocator g_slab_page_allocator = {
@@ -68,7 +168,8 @@ static void* arraylist_alloc(size_t len, size_t* allocated_len) {
 }
 
 static void arraylist_dealloc(void* ptr, size_t len) {
-    dynmem_dealloc(ptr, len);
+    // capacity is no longer a power of two after a shrink
+    dynmem_dealloc_exact(ptr, len);
 }
 
 static size_t arraylist_shrink(void* ptr, size_t old_len, size_t new_len) {
@@ -77,7 +178,7 @@ static size_t arraylist_shrink(void* ptr, size_t old_len, size_t new_len) {
     if (aligned_old == aligned_new) {
         return aligned_old;
     }
-    dynmem_dealloc((char*)ptr + aligned_new, aligned_old - aligned_new);
+    dynmem_dealloc_exact((char*)ptr + aligned_new, aligned_old - aligned_new);
     return aligned_new;
 }
 
@@ -127,58 +228,62 @@ static void construct_mmap_dyn(const struct mmap* mmap_boot) {
         }
     }
     g_mmap_dyn.len = removal_end;
+
+    // the first 3 pages become the first page tables, which a single page table must map
+    struct mmap_entry* first = &g_mmap_dyn.entries[0];
+    const mmap_ulong to_huge = (HUGE_PAGE_SIZE - first->base % HUGE_PAGE_SIZE) % HUGE_PAGE_SIZE;
+    if (to_huge != 0 && to_huge < 3 * PAGE_SIZE) {
+        assert(first->length > to_huge, "dynmem: first memory map entry is too small");
+        first->base += to_huge;
+        first->length -= to_huge;
+    }
+
+    // dynmem offsets for binary search of translation between physical and dynmem addresses.
+    // every entry is padded to be congruent with its physical address, the first one included.
+    g_mmap_dyn_offsets[0] = (first->base - DYNMEM_START_VIRT) & (DYNMEM_VIRT_ALIGN - 1);
+    for (size_t i = 0; i < g_mmap_dyn.len; i++) {
+        const mmap_ulong end = g_mmap_dyn_offsets[i] + g_mmap_dyn.entries[i].length;
+        mmap_ulong padding = 0;
+        if (i + 1 < g_mmap_dyn.len) {
+            padding = (g_mmap_dyn.entries[i + 1].base - (DYNMEM_START_VIRT + end)) & (DYNMEM_VIRT_ALIGN - 1);
+        }
+        g_mmap_dyn_offsets[i + 1] = end + padding;
+    }
+    assert(g_mmap_dyn_offsets[g_mmap_dyn.len] <= DYNMEM_VIRT_SIZE, "dynmem: memory map does not fit the window");
 }
 
-static void mmio_freelist_init(void) {
-    struct mmio_freelist* freelist = &g_meminfo.mmio_freelist;
-    singlylist_init(&freelist->list);
-    memset(freelist->nodes, 0, sizeof(freelist->nodes));
-    freelist->nodes[0].begin = IOMAP_START_VIRT;
-    freelist->nodes[0].end = IOMAP_START_VIRT + IOMAP_VIRT_SIZE;
-    singlylist_push_front(&freelist->list, &freelist->nodes[0].link);
+static struct range_node* mmio_range_node_alloc(void* ctx) {
+    return slab_alloc(ctx);
 }
 
-static struct mmio_free_node* mmio_freelist_newnode(struct mmio_freelist* mfl) {
-    size_t sz = sizeof(mfl->nodes) / sizeof(*mfl->nodes);
-    size_t i = 0;
-    for (; i < sz && mfl->nodes[i].begin != 0; i++) {}
-    if (i == sz) {
-        panic("mmio virtual memory space is too fragmented");
-    }
-    return mfl->nodes + i;
+static void mmio_range_node_dealloc(void* ctx, struct range_node* node) {
+    slab_dealloc(ctx, node);
+}
+
+static void mmio_space_init(void) {
+    SLAB_INIT(&g_meminfo.mmio_range_slab, struct range_node);
+    slab_set_empty_max(&g_meminfo.mmio_range_slab, 1);
+    const struct range_node_allocator na = {
+        .ctx = &g_meminfo.mmio_range_slab,
+        .alloc = mmio_range_node_alloc,
+        .dealloc = mmio_range_node_dealloc,
+    };
+    const bool ok = range_init(&g_meminfo.mmio_space, IOMAP_START_VIRT, IOMAP_START_VIRT + IOMAP_VIRT_SIZE, &na);
+    assert(ok, "mmio: no memory for the free range tree");
+    memory_register_slab(&g_meminfo.mmio_range_slab, "mmio-range", &g_meminfo.lock);
 }
 
-// TODO: unit tests for mmio_*
 volatile void* mmio_alloc_mapping(uintptr_t begin_phys, uintptr_t end_phys) {
     intrlock_acquire(&g_meminfo.lock);
 
     uintptr_t aligned_begin_phys = begin_phys / PAGE_SIZE * PAGE_SIZE;
     uintptr_t aligned_len = uptrdiv_ceil(end_phys - aligned_begin_phys, PAGE_SIZE) * PAGE_SIZE;
 
-    struct mmio_freelist* freelist = &g_meminfo.mmio_freelist;
-    struct singlylist_link* before = singlylist_before_head(&freelist->list);
-    struct singlylist_link* link = before->next;
     uintptr_t begin;
-    for (; link != NULL; before = link, link = link->next) {
-        struct mmio_free_node* node = container_of(link, struct mmio_free_node, link);
+    const bool ok = range_alloc(&g_meminfo.mmio_space, aligned_len, &begin);
+    assert(ok, "mmio virtual memory space is run out");
 
-        begin = node->begin;
-        uintptr_t node_len = node->end - begin;
-        if (node_len < aligned_len) {
-            continue;
-        }
-
-        if (node_len == aligned_len) {
-            node->begin = 0;
-            singlylist_remove_after(before);
-        } else {
-            node->begin += aligned_len;
-        }
-        break;
-    }
-    assert(link != NULL, "mmio virtual memory space is run out");
-
-    pagetable_mmio_map(begin, begin + aligned_len, aligned_begin_phys, KERNEL_PAGE_FLAG, &g_mmap_dyn.mmap);
+    pagetable_mmio_map(begin, begin + aligned_len, aligned_begin_phys, KERNEL_PAGE_FLAG, &g_mmap_dyn_index);
 
     intrlock_release(&g_meminfo.lock);
     return (void*)begin;
@@ -189,84 +294,440 @@ void mmio_dealloc_mapping(uintptr_t begin_virt, uintptr_t end_virt) {
 
     uintptr_t aligned_begin = begin_virt / PAGE_SIZE * PAGE_SIZE;
     uintptr_t aligned_len = uptrdiv_ceil(end_virt - aligned_begin, PAGE_SIZE) * PAGE_SIZE;
-    uintptr_t aligned_end = aligned_begin + aligned_len;
 
-    struct mmio_freelist* freelist = &g_meminfo.mmio_freelist;
-    struct singlylist_link* before_head = singlylist_before_head(&freelist->list);
-    struct singlylist_link* before = before_head;
-    struct singlylist_link* link = before->next;
-    for (; link != NULL; before = link, link = link->next) {
-        struct mmio_free_node* before_node = container_of(before, struct mmio_free_node, link);
-        struct mmio_free_node* node = container_of(link, struct mmio_free_node, link);
+    // fails on addresses that are not mapped, or if no node is left for a new free range
+    const bool ok = range_dealloc(&g_meminfo.mmio_space, aligned_begin, aligned_len);
+    assert(ok, "invalid mmio address");
 
-        if (aligned_begin >= node->begin) {
-            continue;
-        }
+    pagetable_mmio_unmap(aligned_begin, aligned_begin + aligned_len);
+
+    intrlock_release(&g_meminfo.lock);
+}
 
-        uintptr_t before_end = before != before_head ? before_node->end : IOMAP_START_VIRT;
-        assert(before_end <= aligned_begin && aligned_end <= node->begin, "invalid mmio address");
+static unsigned current_cpu(void) {
+    // only the bootstrap processor runs kernel code for now
+    return 0;
+}
 
-        if (aligned_begin + aligned_len == node->begin) {
-            node->begin = aligned_begin;
-        } else if (before != before_head && before_node->end == aligned_begin) {
-            before_node->end += aligned_len;
+static struct dynmem_zone* zone_of_virt(uintptr_t virt) {
+    size_t lo = 0, hi = g_meminfo.zone_count;
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        struct dynmem_zone* zone = &g_meminfo.zones[mid];
+        if (virt < zone->virt_begin) {
+            hi = mid;
+        } else if (virt >= zone->virt_end) {
+            lo = mid + 1;
         } else {
-            struct mmio_free_node* newnode = mmio_freelist_newnode(freelist);
-            newnode->begin = aligned_begin;
-            newnode->end = aligned_begin + aligned_len;
-            singlylist_insert_after(before, &newnode->link);
+            return zone;
+        }
+    }
+    panic("dynmem: invalid virtual address");
+}
+
+uintptr_t dynmem_virt_to_phys(const volatile void* ptr) {
+    return mmap_dyn_virt_to_phys(&g_mmap_dyn_index, (uintptr_t)ptr);
+}
+
+void* dynmem_phys_to_virt(uintptr_t phys) {
+    return (void*)mmap_dyn_phys_to_virt(&g_mmap_dyn_index, phys);
+}
+
+// allocation starts at the zone of the current CPU and falls over to the next zones
+static size_t zone_first(void) {
+    return current_cpu() % g_meminfo.zone_count;
+}
+
+enum zone_alloc_kind {
+    ZONE_ALLOC_BLOCK,
+    ZONE_ALLOC_EXACT,
+    ZONE_ALLOC_CONSTRAINED,
+};
+
+struct zone_alloc_request {
+    enum zone_alloc_kind kind;
+    size_t len;
+    size_t align;
+    uintptr_t lo;
+    uintptr_t hi;
+};
+
+static struct slice zone_alloc(struct dynmem_zone* zone, const struct zone_alloc_request* req) {
+    struct slice s = { .ptr = NULL, .length = 0 };
+
+    intrlock_acquire(&zone->lock);
+    switch (req->kind) {
+        case ZONE_ALLOC_BLOCK:
+            s = buddy_alloc_slice(&zone->buddy, req->len);
+            break;
+        case ZONE_ALLOC_EXACT:
+            s = buddy_alloc_exact(&zone->buddy, req->len);
             break;
+        case ZONE_ALLOC_CONSTRAINED:
+            s = buddy_alloc_constrained(&zone->buddy, req->len, req->align, req->lo, req->hi);
+            break;
+    }
+    intrlock_release(&zone->lock);
+
+    return s;
+}
+
+static struct slice zones_alloc(const struct zone_alloc_request* req) {
+    const size_t count = g_meminfo.zone_count;
+    const size_t first = zone_first();
+    for (size_t n = 0; n < count; n++) {
+        struct slice s = zone_alloc(&g_meminfo.zones[(first + n) % count], req);
+        if (s.ptr) {
+            return s;
+        }
+    }
+    return (struct slice){ .ptr = NULL, .length = 0 };
+}
+
+static void zone_dealloc(struct dynmem_zone* zone, void* ptr, size_t len, bool exact) {
+    intrlock_acquire(&zone->lock);
+    if (exact) {
+        buddy_dealloc_exact(&zone->buddy, ptr, len);
+    } else {
+        buddy_dealloc(&zone->buddy, ptr, len);
+    }
+    intrlock_release(&zone->lock);
+}
+
+static size_t zones_alloc_bulk(size_t order, size_t n, void** out) {
+    const size_t count = g_meminfo.zone_count;
+    const size_t first = zone_first();
+    size_t allocated = 0;
+    for (size_t i = 0; i < count && allocated < n; i++) {
+        struct dynmem_zone* zone = &g_meminfo.zones[(first + i) % count];
+        intrlock_acquire(&zone->lock);
+        allocated += buddy_alloc_bulk(&zone->buddy, order, n - allocated, out + allocated);
+        intrlock_release(&zone->lock);
+    }
+    return allocated;
+}
+
+static void zones_dealloc_bulk(size_t order, size_t n, void* const* ptrs) {
+    // free runs of blocks from the same zone under one lock
+    for (size_t i = 0; i < n; ) {
+        struct dynmem_zone* zone = zone_of_virt((uintptr_t)ptrs[i]);
+        size_t run = 1;
+        for (; i + run < n; run++) {
+            const uintptr_t addr = (uintptr_t)ptrs[i + run];
+            if (addr < zone->virt_begin || addr >= zone->virt_end) {
+                break;
+            }
         }
 
-        if (before != before_head && before_node->end == node->begin) {
-            before_node->end = node->end;
-            node->begin = 0;
-            singlylist_remove_after(before);
+        intrlock_acquire(&zone->lock);
+        buddy_dealloc_bulk(&zone->buddy, order, run, ptrs + i);
+        intrlock_release(&zone->lock);
+        i += run;
+    }
+}
+
+static struct cpu_page_cache* page_cache_enter(void) {
+    struct cpu_page_cache* pcp = &g_meminfo.page_caches[current_cpu()];
+    if (pcp->busy) {
+        return NULL;
+    }
+    pcp->busy = true;
+    compiler_barrier();
+    return pcp;
+}
+
+static void page_cache_leave(struct cpu_page_cache* pcp) {
+    compiler_barrier();
+    pcp->busy = false;
+}
+
+static int page_cache_order(size_t len) {
+    for (int order = 0; order < PAGE_CACHE_ORDERS; order++) {
+        if (len <= (size_t)PAGE_SIZE << order) {
+            return order;
         }
-        break;
     }
-    assert(link != NULL, "invalid mmio address");
+    return -1;
+}
 
-    pagetable_mmio_unmap(aligned_begin, aligned_begin + aligned_len, &g_mmap_dyn.mmap);
+static void* page_cache_alloc(int order) {
+    struct cpu_page_cache* pcp = page_cache_enter();
+    if (!pcp) {
+        return NULL;
+    }
 
-    intrlock_release(&g_meminfo.lock);
+    struct page_cache* cache = &pcp->orders[order];
+    if (cache->count == 0) {
+        cache->count = zones_alloc_bulk(order, g_page_cache_batch[order], cache->pages);
+        cache->misses++;
+    } else {
+        cache->hits++;
+    }
+
+    void* page = cache->count > 0 ? cache->pages[--cache->count] : NULL;
+    page_cache_leave(pcp);
+    return page;
+}
+
+static bool page_cache_dealloc(void* page, int order) {
+    struct cpu_page_cache* pcp = page_cache_enter();
+    if (!pcp) {
+        return false;
+    }
+
+    struct page_cache* cache = &pcp->orders[order];
+    if (cache->count == g_page_cache_capacity[order]) {
+        // return the oldest pages and keep the recently freed, likely cache-hot ones
+        const uint32_t batch = g_page_cache_batch[order];
+        zones_dealloc_bulk(order, batch, cache->pages);
+
+        memmove(cache->pages, cache->pages + batch, (cache->count - batch) * sizeof(void*));
+        cache->count -= batch;
+    }
+
+    cache->pages[cache->count++] = page;
+    page_cache_leave(pcp);
+    return true;
 }
 
-struct slice dynmem_alloc_nolock(size_t len) {
-    return buddy_alloc_slice(&g_meminfo.buddy, len);
+static void page_cache_drain(void) {
+    for (unsigned cpu = 0; cpu < PAGE_CACHE_CPUS; cpu++) {
+        for (int order = 0; order < PAGE_CACHE_ORDERS; order++) {
+            struct page_cache* cache = &g_meminfo.page_caches[cpu].orders[order];
+            zones_dealloc_bulk(order, cache->count, cache->pages);
+            cache->count = 0;
+        }
+    }
 }
 
 struct slice dynmem_alloc(size_t len) {
-    intrlock_acquire(&g_meminfo.lock);
-    struct slice s = dynmem_alloc_nolock(len);
-    intrlock_release(&g_meminfo.lock);
+    const int order = page_cache_order(len);
+    if (order >= 0) {
+        void* page = page_cache_alloc(order);
+        if (page) {
+            return (struct slice){ .ptr = page, .length = (size_t)PAGE_SIZE << order };
+        }
+    }
+
+    const struct zone_alloc_request req = { .kind = ZONE_ALLOC_BLOCK, .len = len };
+    return zones_alloc(&req);
+}
+
+void dynmem_dealloc(void* ptr, size_t len) {
+    if (len == 0) {
+        return;
+    }
+
+    struct dynmem_zone* zone = zone_of_virt((uintptr_t)ptr);
+    const uintptr_t aligned_addr = (uintptr_t)ptr / PAGE_SIZE * PAGE_SIZE;
+    const uintptr_t aligned_end = uptrdiv_ceil((uintptr_t)ptr + len, PAGE_SIZE) * PAGE_SIZE;
+    const int order = page_cache_order(aligned_end - aligned_addr);
+    if (order >= 0) {
+        const struct buddy_blocks* buddy = &zone->buddy;
+        const uintptr_t data_addr = buddy->start_addr + buddy->data_offset;
+        if ((aligned_addr - data_addr) % ((uintptr_t)PAGE_SIZE << order) == 0
+            && page_cache_dealloc((void*)aligned_addr, order)
+        ) {
+            return;
+        }
+    }
+
+    zone_dealloc(zone, ptr, len, false);
+}
+
+struct slice dynmem_alloc_exact(size_t len) {
+    if (page_cache_order(len) >= 0) {
+        // one or two pages are a power of two anyway
+        return dynmem_alloc(len);
+    }
+
+    struct slice s = { .ptr = NULL, .length = 0 };
+    if (len >= HUGE_PAGE_SIZE) {
+        // start large allocations on a huge page boundary so that they can be backed by huge pages
+        s = dynmem_alloc_constrained(len, HUGE_PAGE_SIZE, 0, UINTPTR_MAX);
+    }
+    if (!s.ptr) {
+        const struct zone_alloc_request req = { .kind = ZONE_ALLOC_EXACT, .len = len };
+        s = zones_alloc(&req);
+    }
     return s;
 }
 
-void dynmem_dealloc_nolock(void* ptr, size_t len) {
-    buddy_dealloc(&g_meminfo.buddy, ptr, len);
+struct slice dynmem_alloc_constrained(size_t len, size_t align, uintptr_t lo, uintptr_t hi) {
+    const struct zone_alloc_request req = {
+        .kind = ZONE_ALLOC_CONSTRAINED, .len = len, .align = align, .lo = lo, .hi = hi,
+    };
+    return zones_alloc(&req);
+}
+
+void dynmem_dealloc_exact(void* ptr, size_t len) {
+    if (len != 0) {
+        zone_dealloc(zone_of_virt((uintptr_t)ptr), ptr, len, true);
+    }
 }
 
-void dynmem_dealloc(void* ptr, size_t len) {
+size_t dynmem_alloc_bulk(size_t order, size_t n, void** out) {
+    return zones_alloc_bulk(order, n, out);
+}
+
+void dynmem_dealloc_bulk(size_t order, size_t n, void* const* ptrs) {
+    zones_dealloc_bulk(order, n, ptrs);
+}
+
+static void dynmem_zones_init(void) {
+    // page tables of dynmem itself take the beginning of the window
+    const uintptr_t data_begin = DYNMEM_START_VIRT + g_mmap_dyn_offsets[0] + g_meminfo.dyn_pagetable_len;
+
+    for (uint32_t i = 0; i < g_mmap_dyn.len; i++) {
+        const struct mmap_entry* entry = &g_mmap_dyn.entries[i];
+        const uintptr_t virt = DYNMEM_START_VIRT + g_mmap_dyn_offsets[i];
+        const uintptr_t virt_end = virt + entry->length;
+        uintptr_t begin = MAX(virt, data_begin);
+
+        // the metadata in front of the data shrinks as begin moves up, so move until the data start is aligned
+        struct dynmem_zone* zone = &g_meminfo.zones[g_meminfo.zone_count];
+        while (begin < virt_end && virt_end - begin >= DYNMEM_ZONE_MIN_LEN) {
+#ifdef DYNMEM_BUDDY_FREELIST
+            buddy_init_freelist(&zone->buddy, (void*)begin, virt_end - begin);
+#else
+            buddy_init(&zone->buddy, (void*)begin, virt_end - begin);
+#endif
+            const uintptr_t misalign = (begin + zone->buddy.data_offset) % DYNMEM_DATA_ALIGN;
+            if (misalign == 0) {
+                intrlock_init(&zone->lock);
+                zone->virt_begin = begin;
+                zone->virt_end = virt_end;
+                zone->phys_begin = entry->base + (begin - virt);
+                zone->slab_orders = buddy_alloc_exact(&zone->buddy, zone->buddy.units).ptr;
+                assert(zone->slab_orders, "dynmem: no memory for the slab page map");
+                memset(zone->slab_orders, 0, zone->buddy.units);
+                g_meminfo.zone_count++;
+                break;
+            }
+            begin += DYNMEM_DATA_ALIGN - misalign;
+        }
+    }
+
+    assert(g_meminfo.zone_count > 0, "dynmem: no usable memory");
+}
+
+void memory_register_slab(struct slab_allocator* slab, const char* name, struct intrlock* lock) {
     intrlock_acquire(&g_meminfo.lock);
-    dynmem_dealloc_nolock(ptr, len);
+    assert(g_meminfo.slab_count < SLAB_REGISTRY_MAX, "too many slab caches");
+    g_meminfo.slabs[g_meminfo.slab_count++] = (struct slab_registration){ name, slab, lock };
     intrlock_release(&g_meminfo.lock);
 }
 
+static void kmalloc_lock_acquire(void* ctx) {
+    intrlock_acquire(ctx);
+}
+
+static void kmalloc_lock_release(void* ctx) {
+    intrlock_release(ctx);
+}
+
+static void kmalloc_init(void) {
+    size_t index = 0;
+    for (size_t i = 0; i < KMALLOC_CLASSES; i++) {
+        struct kmalloc_class* c = &g_meminfo.kmalloc_classes[i];
+        intrlock_init(&c->lock);
+        SLAB_INIT_SIZED(&c->slab, g_kmalloc_sizes[i], KMALLOC_ALIGN);
+        // the order is chosen per class by the waste target, so the small classes take single pages
+        // keep a page so a class that drains does not refill it on the next kmalloc
+        slab_set_empty_max(&c->slab, 1);
+        const struct slab_lock lock = { &c->lock, kmalloc_lock_acquire, kmalloc_lock_release };
+        slab_cache_init(&c->cache, &c->slab, c->cpus, KMALLOC_CPUS, &lock);
+        for (unsigned cpu = 0; cpu < KMALLOC_CPUS; cpu++) {
+            c->busy[cpu] = false;
+        }
+        memory_register_slab(&c->slab, g_kmalloc_names[i], &c->lock);
+
+        for (; index * KMALLOC_ALIGN <= g_kmalloc_sizes[i]; index++) {
+            g_meminfo.kmalloc_index[index] = (uint8_t)i;
+        }
+    }
+}
+
+static void* kmalloc_class_alloc(struct kmalloc_class* c) {
+    const unsigned cpu = current_cpu();
+    if (c->busy[cpu]) {
+        // an interrupt came in the middle of the magazines of this cpu, so go to the slab directly
+        intrlock_acquire(&c->lock);
+        void* ptr = slab_alloc(&c->slab);
+        intrlock_release(&c->lock);
+        return ptr;
+    }
+
+    c->busy[cpu] = true;
+    compiler_barrier();
+    void* ptr = slab_cache_alloc(&c->cache, cpu);
+    compiler_barrier();
+    c->busy[cpu] = false;
+    return ptr;
+}
+
+static void kmalloc_class_dealloc(struct kmalloc_class* c, void* ptr) {
+    const unsigned cpu = current_cpu();
+    if (c->busy[cpu]) {
+        intrlock_acquire(&c->lock);
+        slab_dealloc(&c->slab, ptr);
+        intrlock_release(&c->lock);
+        return;
+    }
+
+    c->busy[cpu] = true;
+    compiler_barrier();
+    slab_cache_dealloc(&c->cache, cpu, ptr);
+    compiler_barrier();
+    c->busy[cpu] = false;
+}
+
+void* kmalloc(size_t size) {
+    if (size <= KMALLOC_SMALL_MAX) {
+        const size_t units = szdiv_ceil(size, KMALLOC_ALIGN);
+        return kmalloc_class_alloc(&g_meminfo.kmalloc_classes[g_meminfo.kmalloc_index[units]]);
+    }
+
+    struct slice s = dynmem_alloc_exact(sizeof(struct kmalloc_large) + size);
+    struct kmalloc_large* large = s.ptr;
+    if (!large) {
+        return NULL;
+    }
+    large->len = s.length;
+    return large + 1;
+}
+
+void kfree(void* ptr) {
+    if (!ptr) {
+        return;
+    }
+
+    struct slab_allocator* slab = dynmem_slab_of(ptr);
+    if (!slab) {
+        struct kmalloc_large* large = (struct kmalloc_large*)ptr - 1;
+        dynmem_dealloc_exact(large, large->len);
+        return;
+    }
+
+    kmalloc_class_dealloc(container_of(slab, struct kmalloc_class, slab), ptr);
+}
+
 void memory_init(void) {
     intrlock_init(&g_meminfo.lock);
 
     construct_mmap_dyn(bootinfo_get()->mmap);
 
-    struct pagetable_construct_result r = pagetable_construct(&g_mmap_dyn.mmap);
+    struct pagetable_construct_result r = pagetable_construct(&g_mmap_dyn_index);
     g_meminfo.dyn_total_len = r.dyn_total_len;
     g_meminfo.dyn_pagetable_len = r.dyn_pagetable_len;
+    g_meminfo.dyn_pages[0] = r.dyn_pages_1g;
+    g_meminfo.dyn_pages[1] = r.dyn_pages_2m;
+    g_meminfo.dyn_pages[2] = r.dyn_pages_4k;
 
-    buddy_init(&g_meminfo.buddy,
-        (void*)(DYNMEM_START_VIRT + r.dyn_pagetable_len),
-        r.dyn_total_len - r.dyn_pagetable_len);
+    dynmem_zones_init();
+    kmalloc_init();
 
-    mmio_freelist_init();
+    mmio_space_init();
 }
 
 static void mmap_print(const struct mmap* mmap, const char* title) {
@@ -298,32 +759,122 @@ void mmap_print_dyn(void) {
 
 void pagetable_print(void) {
     intrlock_acquire(&g_meminfo.lock);
-    pagetable_print_with_dyn(&g_mmap_dyn.mmap);
+    pagetable_print_all();
     intrlock_release(&g_meminfo.lock);
 }
 
 void dynmem_print(void) {
-    intrlock_acquire(&g_meminfo.lock);
-
     tty0_printf("===dynamic memory allocator infomation===\n");
-    tty0_printf("metadata address     : %#018zx\n", g_meminfo.buddy.start_addr);
-    tty0_printf("metadata size        : %#018zx\n", g_meminfo.buddy.metadata_len);
-    tty0_printf("count of unit blocks : %#018zx\n", g_meminfo.buddy.units);
-    tty0_printf("total bitmap level   : %u\n", g_meminfo.buddy.levels);
+    tty0_printf("count of zones       : %zu\n", g_meminfo.zone_count);
+    tty0_printf("free block search    : %s\n", g_meminfo.zones[0].buddy.freelist ? "freelist" : "bitmap");
+    tty0_printf("mapped by            : %zu 1GiB, %zu 2MiB, %zu 4KiB pages\n",
+        g_meminfo.dyn_pages[0], g_meminfo.dyn_pages[1], g_meminfo.dyn_pages[2]);
+    tty0_printf("page tables          : %#018zx\n", g_meminfo.dyn_pagetable_len);
+    for (size_t i = 0; i < g_meminfo.zone_count; i++) {
+        struct dynmem_zone* zone = &g_meminfo.zones[i];
+        intrlock_acquire(&zone->lock);
+        tty0_printf("=========================================\n");
+        tty0_printf("zone #%zu              : phys %#018zx\n", i, zone->phys_begin);
+        tty0_printf("metadata address     : %#018zx\n", zone->buddy.start_addr);
+        tty0_printf("metadata size        : %#018zx\n", zone->buddy.metadata_len);
+        tty0_printf("count of unit blocks : %#018zx\n", zone->buddy.units);
+        tty0_printf("total bitmap level   : %u\n", zone->buddy.levels);
+        tty0_printf("start address        : %#018zx\n", zone->buddy.start_addr + zone->buddy.data_offset);
+        tty0_printf("dynmem size          : %#018zx\n", zone->buddy.total_len - zone->buddy.data_offset);
+        tty0_printf("used size            : %#018zx\n", zone->buddy.used);
+        intrlock_release(&zone->lock);
+    }
     tty0_printf("=========================================\n");
-    tty0_printf("start address        : %#018zx\n", g_meminfo.buddy.start_addr + g_meminfo.buddy.data_offset);
-    tty0_printf("dynmem size          : %#018zx\n", g_meminfo.buddy.total_len - g_meminfo.buddy.data_offset);
-    tty0_printf("used size            : %#018zx\n", g_meminfo.buddy.used);
+    for (unsigned cpu = 0; cpu < PAGE_CACHE_CPUS; cpu++) {
+        for (int order = 0; order < PAGE_CACHE_ORDERS; order++) {
+            const struct page_cache* cache = &g_meminfo.page_caches[cpu].orders[order];
+            tty0_printf("cpu%u order%d cache   : %u pages, %"PRIu64" hits, %"PRIu64" misses\n",
+                cpu, order, cache->count, cache->hits, cache->misses);
+        }
+    }
     tty0_printf("=========================================\n");
+}
 
+void memory_get_stats(struct memory_stats* stats) {
+    *stats = (struct memory_stats){ .zone_count = g_meminfo.zone_count };
+    for (size_t i = 0; i < g_meminfo.zone_count; i++) {
+        struct dynmem_zone* zone = &g_meminfo.zones[i];
+        struct buddy_stats bs;
+        intrlock_acquire(&zone->lock);
+        buddy_get_stats(&zone->buddy, &bs);
+        intrlock_release(&zone->lock);
+
+        stats->total += bs.units * BUDDY_UNIT;
+        stats->used += bs.used;
+        stats->free += bs.free;
+        stats->largest_free = MAX(stats->largest_free, bs.largest_free);
+        for (size_t order = 0; order < BUDDY_STATS_LEVELS; order++) {
+            stats->free_blocks[order] += bs.free_blocks[order];
+        }
+    }
+    stats->fragmentation = stats->free == 0 ? 0
+        : (uint32_t)((stats->free - stats->largest_free) * 1000 / stats->free);
+
+    for (unsigned cpu = 0; cpu < PAGE_CACHE_CPUS; cpu++) {
+        for (int order = 0; order < PAGE_CACHE_ORDERS; order++) {
+            stats->cached += (size_t)g_meminfo.page_caches[cpu].orders[order].count * (PAGE_SIZE << order);
+        }
+    }
+
+    intrlock_acquire(&g_meminfo.lock);
+    stats->slab_count = g_meminfo.slab_count;
     intrlock_release(&g_meminfo.lock);
 }
 
-void dynmem_test_seq(void) {
+bool memory_get_slab_stats(size_t index, const char** name, struct slab_stats* stats) {
     intrlock_acquire(&g_meminfo.lock);
+    if (index >= g_meminfo.slab_count) {
+        intrlock_release(&g_meminfo.lock);
+        return false;
+    }
+    const struct slab_registration reg = g_meminfo.slabs[index];
+    intrlock_release(&g_meminfo.lock);
 
-    struct buddy_blocks* buddy = &g_meminfo.buddy;
+    *name = reg.name;
+    if (reg.lock) {
+        intrlock_acquire(reg.lock);
+    }
+    slab_get_stats(reg.slab, stats);
+    if (reg.lock) {
+        intrlock_release(reg.lock);
+    }
+    return true;
+}
 
+void memory_print_stats(void) {
+    struct memory_stats stats;
+    memory_get_stats(&stats);
+
+    tty0_printf("===memory statistics===\n");
+    tty0_printf("dynmem total         : %#018zx in %zu zones\n", stats.total, stats.zone_count);
+    tty0_printf("used size            : %#018zx (%#zx in page caches)\n", stats.used, stats.cached);
+    tty0_printf("free size            : %#018zx\n", stats.free);
+    tty0_printf("largest free block   : %#018zx\n", stats.largest_free);
+    tty0_printf("fragmentation        : %u.%u%%\n", stats.fragmentation / 10, stats.fragmentation % 10);
+    tty0_printf("free blocks by order :");
+    for (size_t order = 0; order < BUDDY_STATS_LEVELS; order++) {
+        if (stats.free_blocks[order] != 0) {
+            tty0_printf(" %zu:%zu", order, stats.free_blocks[order]);
+        }
+    }
+    tty0_printf("\n");
+
+    tty0_printf("%-14s %8s %6s %6s %6s %6s %8s\n", "slab cache", "objects", "pages", "full", "part", "empty", "waste");
+    const char* name;
+    struct slab_stats ss;
+    for (size_t i = 0; memory_get_slab_stats(i, &name, &ss); i++) {
+        tty0_printf("%-14s %8zu %6zu %6zu %6zu %6zu %8zu\n",
+            name, ss.objects, ss.pages, ss.full_pages, ss.partial_pages, ss.empty_pages, ss.waste);
+    }
+    tty0_printf("=======================\n");
+}
+
+static void dynmem_test_seq_zone(struct buddy_blocks* buddy) {
     uintptr_t data_addr = buddy->start_addr + buddy->data_offset;
     tty0_printf("memory chunk starts at %#zx\n", data_addr);
     tty0_printf("data range: [%#zx, %#zx)\n", data_addr, buddy->start_addr + buddy->total_len);
@@ -337,7 +888,7 @@ void dynmem_test_seq(void) {
 
         tty0_printf("Alloc & Comp : ");
         for (size_t index = 0; index < block_count; index++) {
-            volatile uint32_t* slice = dynmem_alloc(size - 1).ptr;
+            volatile uint32_t* slice = buddy_alloc(buddy, size - 1);
             if (slice) {
                 const size_t count = size / 4;
                 for (size_t i = 0; i < count; i++) {
@@ -357,15 +908,25 @@ void dynmem_test_seq(void) {
         tty0_printf("\nDeallocation : ");
         for (size_t index = 0; index < block_count; index++) {
             const uintptr_t addr = buddy->start_addr + buddy->data_offset + size * index;
-            dynmem_dealloc((void*)(addr + 1), size - 1);
+            buddy_dealloc(buddy, (void*)(addr + 1), size - 1);
             tty0_printf(".");
         }
 
         assert(buddy->used == 0);
         tty0_printf("\n");
     }
-    
-    tty0_printf("Done.\n");
+}
 
-    intrlock_release(&g_meminfo.lock);
+void dynmem_test_seq(void) {
+    page_cache_drain();
+
+    for (size_t i = 0; i < g_meminfo.zone_count; i++) {
+        struct dynmem_zone* zone = &g_meminfo.zones[i];
+        intrlock_acquire(&zone->lock);
+        tty0_printf("Zone #%zu\n", i);
+        dynmem_test_seq_zone(&zone->buddy);
+        intrlock_release(&zone->lock);
+    }
+
+    tty0_printf("Done.\n");
 }
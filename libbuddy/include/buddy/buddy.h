@@ -2,6 +2,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 #include "slice.h"
 
@@ -17,10 +18,43 @@ struct buddy_blocks {
     size_t used;
     void* bitmaps;
     size_t bitmaps_len;
+    bool freelist;
 };
 
 void buddy_init(struct buddy_blocks *buddy, void* start_addr, size_t len);
+
+// same allocator, but free blocks are threaded on per-order lists so that
+// allocation does not scan the bitmaps. free blocks must be writable.
+void buddy_init_freelist(struct buddy_blocks *buddy, void* start_addr, size_t len);
 struct slice buddy_alloc_slice(struct buddy_blocks* buddy, size_t len);
 void buddy_dealloc(struct buddy_blocks* buddy, void* addr, size_t len);
 
+// allocate exactly len bytes rounded up to BUDDY_UNIT, the rest of the covering block is freed
+struct slice buddy_alloc_exact(struct buddy_blocks* buddy, size_t len);
+// free any unit-aligned range of allocated memory, e.g. a buddy_alloc_exact() slice or its tail
+void buddy_dealloc_exact(struct buddy_blocks* buddy, void* addr, size_t len);
+
+// allocate len bytes at an address aligned by align (a power of two) inside [lo, hi).
+// the slice need not be a buddy block, free it with buddy_dealloc_exact().
+struct slice buddy_alloc_constrained(struct buddy_blocks* buddy, size_t len, size_t align, uintptr_t lo, uintptr_t hi);
+
+// allocate up to n blocks of (BUDDY_UNIT << order) bytes into out[], returns the count allocated
+size_t buddy_alloc_bulk(struct buddy_blocks* buddy, size_t order, size_t n, void** out);
+void buddy_dealloc_bulk(struct buddy_blocks* buddy, size_t order, size_t n, void* const* ptrs);
+
+#define BUDDY_STATS_LEVELS 64
+
+struct buddy_stats {
+    size_t units;
+    uint32_t levels;
+    size_t used;
+    size_t free;
+    size_t free_blocks[BUDDY_STATS_LEVELS];  // free blocks of (BUDDY_UNIT << order) bytes
+    size_t largest_free;
+    // per mille of free memory outside the largest free block: 0 when all free memory is one block
+    uint32_t fragmentation;
+};
+
+void buddy_get_stats(const struct buddy_blocks* buddy, struct buddy_stats* stats);
+
 #define buddy_alloc(buddy, len) (buddy_alloc_slice(buddy, len).ptr)
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <collections/rbtree.h>
+
+// a free range [begin, end), max_len is the longest free range in its subtree
+struct range_node {
+    struct rbtree_node node;
+    uintptr_t begin;
+    uintptr_t end;
+    size_t max_len;
+};
+
+struct range_node_allocator {
+    void* ctx;
+    struct range_node* (*alloc)(void* ctx);
+    void (*dealloc)(void* ctx, struct range_node* node);
+};
+
+// first-fit allocator of address ranges, e.g. a virtual address window. it only keeps track of
+// the free ranges, one node each in a tree ordered by address, so allocation, free and
+// coalescing are O(log n) in the number of free ranges.
+struct range_allocator {
+    struct rbtree free_tree;
+    struct range_node_allocator node_allocator;
+    uintptr_t begin;
+    uintptr_t end;
+    size_t free;
+    size_t node_count;
+};
+
+// returns false if the node for the initial free range cannot be allocated
+bool range_init(struct range_allocator* ra, uintptr_t begin, uintptr_t end, const struct range_node_allocator* na);
+// frees every node, ranges still allocated are forgotten
+void range_destroy(struct range_allocator* ra);
+
+// the lowest free range of len bytes, false if none is long enough
+bool range_alloc(struct range_allocator* ra, size_t len, uintptr_t* begin);
+// returns a range taken by range_alloc(), or any part of one. false if it overlaps free space
+// or lies outside the allocator, or if a node is needed and cannot be allocated.
+bool range_dealloc(struct range_allocator* ra, uintptr_t begin, size_t len);
+
+size_t range_largest_free(const struct range_allocator* ra);
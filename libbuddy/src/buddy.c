@@ -3,23 +3,32 @@
 #include <freec/string.h>
 #include <freec/assert.h>
 #include <freec/stdlib.h>
+#include <collections/linkedlist.h>
+
+#define WORD_BITS 64
 
 struct block_bitmap {
-    uint8_t* bits;
+    uint64_t* words;
     size_t count;
+    size_t hint;    // every word before hint is zero, stays 0 if buddy->freelist
+    struct linkedlist free_list;    // free blocks of this level, used only if buddy->freelist
 };
 
+static size_t words_for_blocks(size_t block_count) {
+    return (block_count - 1) / WORD_BITS + 1;
+}
+
 static void buddy_info_calc_metadata(struct buddy_blocks* buddy, size_t data_len) {
     assert(data_len > BUDDY_UNIT);
 
     uint32_t levels = 0;
-    uint32_t bits = 0;
+    size_t words = 0;
     const size_t units = (data_len - 1) / BUDDY_UNIT + 1;
     size_t block_count = units;
 
     while (1) {
         levels++;
-        bits += (block_count - 1) / 8 + 1;
+        words += words_for_blocks(block_count);
 
         if (block_count == 1) {
             break;
@@ -27,7 +36,7 @@ static void buddy_info_calc_metadata(struct buddy_blocks* buddy, size_t data_len
         block_count /= 2;
     }
 
-    const size_t metadata_len = levels * sizeof(struct block_bitmap) + bits;
+    const size_t metadata_len = levels * sizeof(struct block_bitmap) + words * sizeof(uint64_t);
     assert(metadata_len < data_len);
 
     // start_addr, total_len, data_offset are not decided
@@ -47,43 +56,54 @@ static void buddy_info_init(struct buddy_blocks* buddy, void* start_addr, size_t
     buddy->data_offset = data_offset;
 }
 
-void buddy_init(struct buddy_blocks* buddy, void* start_addr, size_t total_len) {
+static void mark_free(struct buddy_blocks* buddy, size_t level, size_t block_index);
+
+static void buddy_init_engine(struct buddy_blocks* buddy, void* start_addr, size_t total_len, bool freelist) {
     buddy_info_init(buddy, start_addr, total_len);
 
     const size_t bitmaps_len = buddy->levels;
     const size_t bitmaps_bytes = bitmaps_len * sizeof(struct block_bitmap);
     struct block_bitmap* const bitmaps = (struct block_bitmap*)start_addr;
 
-    const size_t total_bits_len = buddy->metadata_len - bitmaps_bytes;
-    uint8_t* const total_bits = (uint8_t*)start_addr + bitmaps_bytes;
+    const size_t total_words_len = (buddy->metadata_len - bitmaps_bytes) / sizeof(uint64_t);
+    uint64_t* const total_words = (uint64_t*)((char*)start_addr + bitmaps_bytes);
 
-    memset(total_bits, 0, total_bits_len);
+    memset(total_words, 0, total_words_len * sizeof(uint64_t));
+
+    buddy->used = 0;
+    buddy->bitmaps = bitmaps;
+    buddy->bitmaps_len = bitmaps_len;
+    buddy->freelist = freelist;
 
     size_t block_count = buddy->units;
-    size_t bits_idx = 0;
+    size_t words_idx = 0;
     size_t idx = 0;
     do {
-        const size_t bits_len = (block_count - 1) / 8 + 1;
+        const size_t words_len = words_for_blocks(block_count);
+
+        bitmaps[idx] = (struct block_bitmap){
+            .words = total_words + words_idx, .count = 0, .hint = freelist ? 0 : words_len };
+        linkedlist_init(&bitmaps[idx].free_list);
 
-        size_t count = 0;
         if (block_count % 2 != 0) {
-            total_bits[bits_idx + bits_len - 1] = 1 << (block_count % 8 - 1);
-            count = 1;
+            mark_free(buddy, idx, block_count - 1);
         }
 
-        bitmaps[idx] = (struct block_bitmap){ .bits = total_bits + bits_idx, .count = count };
-
-        bits_idx += bits_len;
+        words_idx += words_len;
         idx += 1;
         block_count /= 2;
     } while (block_count != 0);
 
-    assert(bits_idx == total_bits_len);
+    assert(words_idx == total_words_len);
     assert(idx == bitmaps_len);
+}
 
-    buddy->used = 0;
-    buddy->bitmaps = bitmaps;
-    buddy->bitmaps_len = bitmaps_len;
+void buddy_init(struct buddy_blocks* buddy, void* start_addr, size_t total_len) {
+    buddy_init_engine(buddy, start_addr, total_len, false);
+}
+
+void buddy_init_freelist(struct buddy_blocks* buddy, void* start_addr, size_t total_len) {
+    buddy_init_engine(buddy, start_addr, total_len, true);
 }
 
 static size_t bitmap_index_for_size(size_t size) {
@@ -96,37 +116,144 @@ static bool is_empty(struct block_bitmap* bitmap) {
     return bitmap->count == 0;
 }
 
+static uint64_t bit_mask(size_t block_index) {
+    return (uint64_t)1 << (block_index % WORD_BITS);
+}
+
 static bool get_bit(struct block_bitmap* bitmap, size_t block_index) {
-    return (bitmap->bits[block_index / 8] & (1 << (block_index % 8))) != 0;
+    return (bitmap->words[block_index / WORD_BITS] & bit_mask(block_index)) != 0;
 }
 
 static void set_1(struct block_bitmap* bitmap, size_t block_index) {
-    const bool prev = get_bit(bitmap, block_index);
-    bitmap->bits[block_index / 8] |= 1 << (block_index % 8);
-    if (!prev) {
+    const size_t word_index = block_index / WORD_BITS;
+    uint64_t* const word = &bitmap->words[word_index];
+    if ((*word & bit_mask(block_index)) == 0) {
+        *word |= bit_mask(block_index);
         bitmap->count += 1;
+        if (word_index < bitmap->hint) {
+            bitmap->hint = word_index;
+        }
     }
 }
 
 static void set_0(struct block_bitmap* bitmap, size_t block_index) {
-    const bool prev = get_bit(bitmap, block_index);
-    bitmap->bits[block_index / 8] &= ~(1 << (block_index % 8));
-    if (prev) {
+    const size_t word_index = block_index / WORD_BITS;
+    uint64_t* const word = &bitmap->words[word_index];
+    if ((*word & bit_mask(block_index)) != 0) {
+        *word &= ~bit_mask(block_index);
         bitmap->count -= 1;
+        if (*word == 0 && word_index == bitmap->hint) {
+            bitmap->hint += 1;
+        }
     }
 }
 
 static size_t get_first_1(struct block_bitmap* bitmap) {
     assert(!is_empty(bitmap));
 
-    size_t bits_idx = 0;
-    for (; bitmap->bits[bits_idx] == 0; bits_idx++) {}
+    size_t word_index = bitmap->hint;
+    for (; bitmap->words[word_index] == 0; word_index++) {}
+    bitmap->hint = word_index;
+
+    return word_index * WORD_BITS + (size_t)__builtin_ctzll(bitmap->words[word_index]);
+}
+
+// first free block in [from, to), or to if there is none
+static size_t next_1(struct block_bitmap* bitmap, size_t from, size_t to) {
+    size_t word_index = from / WORD_BITS;
+    uint64_t mask = ~(uint64_t)0 << (from % WORD_BITS);
+    if (word_index < bitmap->hint) {
+        word_index = bitmap->hint;
+        mask = ~(uint64_t)0;
+    }
+
+    for (; word_index * WORD_BITS < to; word_index++) {
+        const uint64_t word = bitmap->words[word_index] & mask;
+        if (word != 0) {
+            return MIN(word_index * WORD_BITS + (size_t)__builtin_ctzll(word), to);
+        }
+        mask = ~(uint64_t)0;
+    }
+    return to;
+}
+
+static struct block_bitmap* bitmap_at(struct buddy_blocks* buddy, size_t level) {
+    return ((struct block_bitmap*)buddy->bitmaps) + level;
+}
+
+static size_t block_size_at(size_t level) {
+    return (size_t)BUDDY_UNIT << level;
+}
+
+static void* block_addr(struct buddy_blocks* buddy, size_t level, size_t block_index) {
+    const uintptr_t data_addr = buddy->start_addr + buddy->data_offset;
+    return (void*)(data_addr + block_index * block_size_at(level));
+}
+
+static struct linkedlist_link* block_link(struct buddy_blocks* buddy, size_t level, size_t block_index) {
+    return block_addr(buddy, level, block_index);
+}
+
+// in freelist mode the lists find free blocks and the bits only answer whether a buddy is free,
+// so the hint is not maintained
+static void mark_free(struct buddy_blocks* buddy, size_t level, size_t block_index) {
+    struct block_bitmap* const bitmap = bitmap_at(buddy, level);
+    assert(!get_bit(bitmap, block_index));
+    if (buddy->freelist) {
+        bitmap->words[block_index / WORD_BITS] |= bit_mask(block_index);
+        bitmap->count += 1;
+        linkedlist_push_front(&bitmap->free_list, block_link(buddy, level, block_index));
+    } else {
+        set_1(bitmap, block_index);
+    }
+}
+
+static void mark_used(struct buddy_blocks* buddy, size_t level, size_t block_index) {
+    struct block_bitmap* const bitmap = bitmap_at(buddy, level);
+    assert(get_bit(bitmap, block_index));
+    if (buddy->freelist) {
+        bitmap->words[block_index / WORD_BITS] &= ~bit_mask(block_index);
+        bitmap->count -= 1;
+        linkedlist_remove(block_link(buddy, level, block_index));
+    } else {
+        set_0(bitmap, block_index);
+    }
+}
+
+static size_t first_free(struct buddy_blocks* buddy, size_t level) {
+    struct block_bitmap* const bitmap = bitmap_at(buddy, level);
+    if (!buddy->freelist) {
+        return get_first_1(bitmap);
+    }
+
+    assert(!is_empty(bitmap));
+    const uintptr_t data_addr = buddy->start_addr + buddy->data_offset;
+    const uintptr_t addr = (uintptr_t)linkedlist_head(&bitmap->free_list);
+    return (addr - data_addr) / block_size_at(level);
+}
+
+// allocate a block of level_fit by splitting the first free block at or above it
+static void* alloc_block(struct buddy_blocks* buddy, size_t level_fit) {
+    for (size_t bitmap_idx = level_fit; bitmap_idx < buddy->bitmaps_len; bitmap_idx++) {
+        if (is_empty(bitmap_at(buddy, bitmap_idx))) {
+            continue;
+        }
 
-    size_t offset = 0;
-    for (; offset < 8 && (bitmap->bits[bits_idx] & (1 << offset)) == 0; offset++) {}
-    assert(offset < 8);
+        const size_t block_index = first_free(buddy, bitmap_idx);
+        mark_used(buddy, bitmap_idx, block_index);
 
-    return bits_idx * 8 + offset;
+        size_t below_block_index = block_index;
+        for (size_t below = bitmap_idx; below-- > level_fit; ) {
+            below_block_index *= 2;
+            mark_free(buddy, below, below_block_index + 1);
+        }
+
+        buddy->used += block_size_at(level_fit);
+        return block_addr(buddy, bitmap_idx, block_index);
+    }
+
+    // there is no memory to allocate
+    return NULL;
 }
 
 struct slice buddy_alloc_slice(struct buddy_blocks* buddy, size_t len) {
@@ -134,44 +261,157 @@ struct slice buddy_alloc_slice(struct buddy_blocks* buddy, size_t len) {
 
     const size_t aligned_len = szdiv_ceil(len, BUDDY_UNIT) * BUDDY_UNIT;
     const size_t bitmap_idx_fit = bitmap_index_for_size(aligned_len);
-    const size_t bitmaps_len = buddy->bitmaps_len;
 
-    if (bitmap_idx_fit >= bitmaps_len) {
+    if (bitmap_idx_fit >= buddy->bitmaps_len) {
         // requested memory is too large
         return (struct slice){ .ptr = NULL, .length = 0 };
     }
 
-    for (size_t bitmap_idx = bitmap_idx_fit; bitmap_idx < bitmaps_len; bitmap_idx++) {
-        struct block_bitmap* const bitmap = ((struct block_bitmap*)buddy->bitmaps) + bitmap_idx;
+    void* const ptr = alloc_block(buddy, bitmap_idx_fit);
+    if (!ptr) {
+        return (struct slice){ .ptr = NULL, .length = 0 };
+    }
+    return (struct slice){ .ptr = ptr, .length = block_size_at(bitmap_idx_fit) };
+}
 
-        if (is_empty(bitmap)) {
-            continue;
-        }
+static size_t unit_index(struct buddy_blocks* buddy, void* addr) {
+    const uintptr_t data_addr = buddy->start_addr + buddy->data_offset;
+    return ((uintptr_t)addr - data_addr) / BUDDY_UNIT;
+}
 
-        const size_t block_index = get_first_1(bitmap);
-        set_0(bitmap, block_index);
+// level of the largest aligned block at unit pos that does not go past unit end
+static size_t tile_level(struct buddy_blocks* buddy, size_t pos, size_t end) {
+    const size_t top = buddy->bitmaps_len - 1;
+    size_t level = pos != 0 ? MIN((size_t)__builtin_ctzll(pos), top) : top;
+    while (pos + ((size_t)1 << level) > end) {
+        level--;
+    }
+    return level;
+}
 
-        size_t below_block_index = block_index;
-        for (size_t below = bitmap_idx; below-- > bitmap_idx_fit; ) {
-            below_block_index *= 2;
-            struct block_bitmap* const below_bitmap = ((struct block_bitmap*)buddy->bitmaps) + below;
-            set_1(below_bitmap, below_block_index + 1);
-        }
+// mark units [pos, end) of a block just taken by mark_used() free again.
+// the buddy of each piece overlaps the part that is kept, so nothing can coalesce here.
+static void free_tiles(struct buddy_blocks* buddy, size_t pos, size_t end) {
+    while (pos < end) {
+        const size_t level = tile_level(buddy, pos, end);
+        mark_free(buddy, level, pos >> level);
+        pos += (size_t)1 << level;
+    }
+}
+
+struct slice buddy_alloc_exact(struct buddy_blocks* buddy, size_t len) {
+    assert(len != 0);
+
+    const size_t units = szdiv_ceil(len, BUDDY_UNIT);
+    const size_t bitmap_idx_fit = bitmap_index_for_size(units * BUDDY_UNIT);
+
+    if (bitmap_idx_fit >= buddy->bitmaps_len) {
+        // requested memory is too large
+        return (struct slice){ .ptr = NULL, .length = 0 };
+    }
 
-        uint32_t allocated_len = BUDDY_UNIT << bitmap_idx_fit;
-        buddy->used += allocated_len;
+    void* const ptr = alloc_block(buddy, bitmap_idx_fit);
+    if (!ptr) {
+        return (struct slice){ .ptr = NULL, .length = 0 };
+    }
 
-        const uintptr_t data_addr = buddy->start_addr + buddy->data_offset;
-        return (struct slice){
-            .ptr = (void*)(data_addr + block_index * (BUDDY_UNIT << bitmap_idx)),
-            .length = allocated_len,
-        };
+    // give the unused tail back
+    const size_t first_unit = unit_index(buddy, ptr);
+    free_tiles(buddy, first_unit + units, first_unit + ((size_t)1 << bitmap_idx_fit));
+    buddy->used -= (((size_t)1 << bitmap_idx_fit) - units) * BUDDY_UNIT;
+
+    return (struct slice){ .ptr = ptr, .length = units * BUDDY_UNIT };
+}
+
+struct slice buddy_alloc_constrained(struct buddy_blocks* buddy, size_t len, size_t align, uintptr_t lo, uintptr_t hi) {
+    assert(len != 0);
+    assert(align != 0 && (align & (align - 1)) == 0);
+
+    const size_t units = szdiv_ceil(len, BUDDY_UNIT);
+    const size_t aligned_len = units * BUDDY_UNIT;
+    const size_t bitmap_idx_fit = bitmap_index_for_size(aligned_len);
+    align = MAX(align, (size_t)BUDDY_UNIT);
+
+    const uintptr_t data_addr = buddy->start_addr + buddy->data_offset;
+    lo = MAX(lo, data_addr);
+    hi = MIN(hi, data_addr + buddy->units * BUDDY_UNIT);
+    if (bitmap_idx_fit >= buddy->bitmaps_len || lo >= hi || hi - lo < aligned_len) {
+        return (struct slice){ .ptr = NULL, .length = 0 };
+    }
+
+    // look only at free blocks that overlap [lo, hi), and take the first one
+    // with room for an aligned range of len bytes inside the window
+    for (size_t level = bitmap_idx_fit; level < buddy->bitmaps_len; level++) {
+        struct block_bitmap* const bitmap = bitmap_at(buddy, level);
+        const size_t size = block_size_at(level);
+        const size_t from = (lo - data_addr) / size;
+        const size_t to = MIN(szdiv_ceil(hi - data_addr, size), buddy->units >> level);
+
+        for (size_t idx = next_1(bitmap, from, to); idx < to; idx = next_1(bitmap, idx + 1, to)) {
+            const uintptr_t block = (uintptr_t)block_addr(buddy, level, idx);
+            const uintptr_t ptr = uptrdiv_ceil(MAX(block, lo), align) * align;
+            if (ptr + aligned_len > MIN(block + size, hi)) {
+                continue;
+            }
+
+            // keep [ptr, ptr + len) and give the rest of the block back
+            mark_used(buddy, level, idx);
+            const size_t first_unit = idx << level;
+            const size_t kept_unit = unit_index(buddy, (void*)ptr);
+            free_tiles(buddy, first_unit, kept_unit);
+            free_tiles(buddy, kept_unit + units, first_unit + ((size_t)1 << level));
+
+            buddy->used += aligned_len;
+            return (struct slice){ .ptr = (void*)ptr, .length = aligned_len };
+        }
     }
 
     // there is no memory to allocate
     return (struct slice){ .ptr = NULL, .length = 0 };
 }
 
+size_t buddy_alloc_bulk(struct buddy_blocks* buddy, size_t order, size_t n, void** out) {
+    if (order >= buddy->bitmaps_len) {
+        return 0;
+    }
+
+    const size_t top = buddy->bitmaps_len - 1;
+    const size_t size = block_size_at(order);
+    size_t count = 0;
+
+    while (count < n) {
+        // take the largest free block that is entirely consumed by the remaining request
+        // and cut it into pieces, instead of splitting it level by level
+        const size_t want = n - count;
+        size_t level = order;
+        while (level < top && ((size_t)2 << (level - order)) <= want) {
+            level++;
+        }
+        for (; level > order && is_empty(bitmap_at(buddy, level)); level--) {}
+
+        if (is_empty(bitmap_at(buddy, level))) {
+            void* const ptr = alloc_block(buddy, order);
+            if (!ptr) {
+                break;
+            }
+            out[count++] = ptr;
+            continue;
+        }
+
+        const size_t block_index = first_free(buddy, level);
+        mark_used(buddy, level, block_index);
+
+        const uintptr_t block = (uintptr_t)block_addr(buddy, level, block_index);
+        const size_t pieces = (size_t)1 << (level - order);
+        for (size_t i = 0; i < pieces; i++) {
+            out[count++] = (void*)(block + i * size);
+        }
+        buddy->used += block_size_at(level);
+    }
+
+    return count;
+}
+
 void buddy_dealloc(struct buddy_blocks* buddy, void* addr, size_t len) {
     if (len == 0) {
         return;
@@ -192,28 +432,68 @@ void buddy_dealloc(struct buddy_blocks* buddy, void* addr, size_t len) {
 
     assert(bitmap_idx_fit < bitmaps_len);
 
-    size_t block_index = (aligned_addr - data_addr) / (BUDDY_UNIT << bitmap_idx_fit);
+    size_t block_index = (aligned_addr - data_addr) / block_size_at(bitmap_idx_fit);
     size_t current = bitmap_idx_fit;
     while (1) {
-        struct block_bitmap* const bitmap = ((struct block_bitmap*)buddy->bitmaps) + current;
+        struct block_bitmap* const bitmap = bitmap_at(buddy, current);
 
         assert(!get_bit(bitmap, block_index));
-        set_1(bitmap, block_index);
 
         const size_t buddy_index = block_index ^ 1;
-        if (!get_bit(bitmap, buddy_index)) {
-            break;
-        }
-        if (current + 1 >= bitmaps_len) {
+        if (!get_bit(bitmap, buddy_index) || current + 1 >= bitmaps_len) {
+            mark_free(buddy, current, block_index);
             break;
         }
 
-        set_0(bitmap, buddy_index);
-        set_0(bitmap, block_index);
+        mark_used(buddy, current, buddy_index);
 
         block_index /= 2;
         current += 1;
     }
 
-    buddy->used -= BUDDY_UNIT << bitmap_idx_fit;
+    buddy->used -= block_size_at(bitmap_idx_fit);
+}
+
+void buddy_dealloc_bulk(struct buddy_blocks* buddy, size_t order, size_t n, void* const* ptrs) {
+    const size_t size = block_size_at(order);
+    for (size_t i = 0; i < n; i++) {
+        buddy_dealloc(buddy, ptrs[i], size);
+    }
+}
+
+void buddy_dealloc_exact(struct buddy_blocks* buddy, void* addr, size_t len) {
+    if (len == 0) {
+        return;
+    }
+
+    const uintptr_t aligned_addr = (uintptr_t)addr / BUDDY_UNIT * BUDDY_UNIT;
+    const uintptr_t aligned_end = uptrdiv_ceil((uintptr_t)addr + len, BUDDY_UNIT) * BUDDY_UNIT;
+
+    // free the range as the largest aligned blocks that tile it
+    const size_t end = unit_index(buddy, (void*)aligned_end);
+    for (size_t pos = unit_index(buddy, (void*)aligned_addr); pos < end; ) {
+        const size_t level = tile_level(buddy, pos, end);
+        buddy_dealloc(buddy, block_addr(buddy, level, pos >> level), block_size_at(level));
+        pos += (size_t)1 << level;
+    }
+}
+
+void buddy_get_stats(const struct buddy_blocks* buddy, struct buddy_stats* stats) {
+    const struct block_bitmap* const bitmaps = buddy->bitmaps;
+
+    stats->units = buddy->units;
+    stats->levels = buddy->levels;
+    stats->used = buddy->used;
+    stats->free = 0;
+    stats->largest_free = 0;
+    for (size_t level = 0; level < BUDDY_STATS_LEVELS; level++) {
+        const size_t count = level < buddy->bitmaps_len ? bitmaps[level].count : 0;
+        stats->free_blocks[level] = count;
+        stats->free += count * block_size_at(level);
+        if (count > 0) {
+            stats->largest_free = block_size_at(level);
+        }
+    }
+    stats->fragmentation = stats->free == 0 ? 0
+        : (uint32_t)((stats->free - stats->largest_free) * 1000 / stats->free);
 }
@@ -0,0 +1,148 @@
+#include "buddy/range.h"
+#include <freec/stdlib.h>
+#include <freec/assert.h>
+
+static struct range_node* range_node_of(const struct rbtree_node* node) {
+    return node == NULL ? NULL : container_of(node, struct range_node, node);
+}
+
+static size_t range_len(const struct range_node* node) {
+    return node->end - node->begin;
+}
+
+static int range_compare(const struct rbtree_node* lhs, const struct rbtree_node* rhs) {
+    const uintptr_t a = range_node_of(lhs)->begin;
+    const uintptr_t b = range_node_of(rhs)->begin;
+    return (a > b) - (a < b);
+}
+
+static int range_compare_addr(const void* key, const struct rbtree_node* node) {
+    const uintptr_t a = *(const uintptr_t*)key;
+    const uintptr_t b = range_node_of(node)->begin;
+    return (a > b) - (a < b);
+}
+
+static void range_augment(struct rbtree_node* node) {
+    struct range_node* r = range_node_of(node);
+    r->max_len = range_len(r);
+    if (node->left != NULL) {
+        r->max_len = MAX(r->max_len, range_node_of(node->left)->max_len);
+    }
+    if (node->right != NULL) {
+        r->max_len = MAX(r->max_len, range_node_of(node->right)->max_len);
+    }
+}
+
+static const struct rbtree_ops g_range_ops = {
+    .compare = range_compare,
+    .augment = range_augment,
+};
+
+static bool range_insert(struct range_allocator* ra, uintptr_t begin, uintptr_t end) {
+    struct range_node* r = ra->node_allocator.alloc(ra->node_allocator.ctx);
+    if (r == NULL) {
+        return false;
+    }
+    r->begin = begin;
+    r->end = end;
+    r->max_len = end - begin;
+    rbtree_insert(&ra->free_tree, &r->node);
+    ra->node_count++;
+    return true;
+}
+
+static void range_remove(struct range_allocator* ra, struct range_node* r) {
+    rbtree_remove(&ra->free_tree, &r->node);
+    ra->node_allocator.dealloc(ra->node_allocator.ctx, r);
+    ra->node_count--;
+}
+
+bool range_init(struct range_allocator* ra, uintptr_t begin, uintptr_t end, const struct range_node_allocator* na) {
+    assert(begin < end);
+    rbtree_init_ops(&ra->free_tree, &g_range_ops);
+    ra->node_allocator = *na;
+    ra->begin = begin;
+    ra->end = end;
+    ra->free = end - begin;
+    ra->node_count = 0;
+    return range_insert(ra, begin, end);
+}
+
+void range_destroy(struct range_allocator* ra) {
+    while (ra->free_tree.root != NULL) {
+        range_remove(ra, range_node_of(ra->free_tree.root));
+    }
+    ra->free = 0;
+}
+
+bool range_alloc(struct range_allocator* ra, size_t len, uintptr_t* begin) {
+    assert(len > 0);
+    struct rbtree_node* node = ra->free_tree.root;
+    if (node == NULL || range_node_of(node)->max_len < len) {
+        return false;
+    }
+
+    // descend to the lowest range that fits: left whenever the left subtree has one
+    struct range_node* r;
+    while (1) {
+        r = range_node_of(node);
+        if (node->left != NULL && range_node_of(node->left)->max_len >= len) {
+            node = node->left;
+        } else if (range_len(r) >= len) {
+            break;
+        } else {
+            node = node->right;
+        }
+    }
+
+    *begin = r->begin;
+    ra->free -= len;
+    if (range_len(r) == len) {
+        range_remove(ra, r);
+    } else {
+        // still between the same neighbors, so the order holds
+        r->begin += len;
+        rbtree_augment_update(&ra->free_tree, &r->node);
+    }
+    return true;
+}
+
+bool range_dealloc(struct range_allocator* ra, uintptr_t begin, size_t len) {
+    const uintptr_t end = begin + len;
+    if (len == 0 || begin < ra->begin || end > ra->end || end < begin) {
+        return false;
+    }
+
+    struct rbtree_find_result f = rbtree_find_by(&ra->free_tree, &begin, range_compare_addr);
+    struct range_node* prev = range_node_of(f.lower);
+    struct range_node* next = range_node_of(f.upper);
+    if (prev != NULL && prev == next) {
+        return false;   // begin is the start of a free range
+    }
+    if ((prev != NULL && prev->end > begin) || (next != NULL && next->begin < end)) {
+        return false;
+    }
+
+    const bool join_prev = prev != NULL && prev->end == begin;
+    const bool join_next = next != NULL && next->begin == end;
+    if (join_prev && join_next) {
+        const uintptr_t next_end = next->end;
+        range_remove(ra, next);
+        prev->end = next_end;
+        rbtree_augment_update(&ra->free_tree, &prev->node);
+    } else if (join_prev) {
+        prev->end = end;
+        rbtree_augment_update(&ra->free_tree, &prev->node);
+    } else if (join_next) {
+        next->begin = begin;
+        rbtree_augment_update(&ra->free_tree, &next->node);
+    } else if (!range_insert(ra, begin, end)) {
+        return false;
+    }
+    ra->free += len;
+    return true;
+}
+
+size_t range_largest_free(const struct range_allocator* ra) {
+    return ra->free_tree.root == NULL ? 0 : range_node_of(ra->free_tree.root)->max_len;
+}
@@ -0,0 +1,124 @@
+#include <iostream>
+#include <gtest/gtest.h>
+
+extern "C" {
+#define restrict
+#include "buddy/buddy.h"
+};
+
+#include <stdint.h>
+#include <vector>
+#include <chrono>
+
+struct alignas(4096) bench_page {
+    uint64_t buf[512];
+};
+
+struct bench_buddy {
+    buddy_blocks buddy;
+    std::vector<bench_page> mem;
+    bench_buddy(size_t len, bool freelist) {
+        mem.resize(len / sizeof(bench_page));
+        if (freelist) {
+            buddy_init_freelist(&buddy, mem.data(), mem.size() * sizeof(bench_page));
+        } else {
+            buddy_init(&buddy, mem.data(), mem.size() * sizeof(bench_page));
+        }
+    }
+    buddy_blocks* get() {
+        return &buddy;
+    }
+    buddy_blocks* operator ->() {
+        return &buddy;
+    }
+};
+
+template <typename F>
+static double measure_ns(size_t ops, F&& f) {
+    const auto begin = std::chrono::steady_clock::now();
+    f();
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - begin).count() / ops;
+}
+
+static std::vector<void*> fill_units(buddy_blocks* buddy) {
+    std::vector<void*> ptrs;
+    while (void* ptr = buddy_alloc(buddy, BUDDY_UNIT)) {
+        ptrs.push_back(ptr);
+    }
+    return ptrs;
+}
+
+static const char* engine_name(bool freelist) {
+    return freelist ? "freelist" : "bitmap";
+}
+
+// allocation latency when the only free units are at the end of a 64MiB pool
+static void bench_mostly_full(bool freelist) {
+    bench_buddy buddy(0x04000000, freelist);
+    std::vector<void*> ptrs = fill_units(buddy.get());
+    ASSERT_FALSE(ptrs.empty());
+
+    const size_t holes = 16;
+    for (size_t i = 0; i < holes; i++) {
+        buddy_dealloc(buddy.get(), ptrs[ptrs.size() - 1 - i * 2], BUDDY_UNIT);
+    }
+    const size_t used = buddy->used;
+
+    const size_t rounds = 20000;
+    const double ns = measure_ns(rounds * holes, [&] {
+        std::vector<void*> got(holes);
+        for (size_t r = 0; r < rounds; r++) {
+            for (size_t i = 0; i < holes; i++) {
+                got[i] = buddy_alloc(buddy.get(), BUDDY_UNIT);
+            }
+            for (size_t i = 0; i < holes; i++) {
+                buddy_dealloc(buddy.get(), got[i], BUDDY_UNIT);
+            }
+        }
+    });
+    std::cout << engine_name(freelist) << " units: " << buddy->units << ", alloc+dealloc: " << ns << " ns/op\n";
+
+    ASSERT_EQ(buddy->used, used);
+}
+
+TEST(buddy_bench, alloc_mostly_full) {
+    bench_mostly_full(false);
+    bench_mostly_full(true);
+}
+
+// allocation latency on a pool whose free units are scattered over the whole pool
+static void bench_fragmented(bool freelist) {
+    bench_buddy buddy(0x04000000, freelist);
+    std::vector<void*> ptrs = fill_units(buddy.get());
+    ASSERT_FALSE(ptrs.empty());
+
+    size_t holes = 0;
+    for (size_t i = 0; i < ptrs.size(); i += 64) {
+        buddy_dealloc(buddy.get(), ptrs[i], BUDDY_UNIT);
+        holes++;
+    }
+    const size_t used = buddy->used;
+
+    const size_t rounds = 100;
+    const double ns = measure_ns(rounds * holes, [&] {
+        std::vector<void*> got(holes);
+        for (size_t r = 0; r < rounds; r++) {
+            for (size_t i = 0; i < holes; i++) {
+                got[i] = buddy_alloc(buddy.get(), BUDDY_UNIT);
+            }
+            for (size_t i = 0; i < holes; i++) {
+                buddy_dealloc(buddy.get(), got[i], BUDDY_UNIT);
+            }
+        }
+    });
+    std::cout << engine_name(freelist) << " units: " << buddy->units << ", holes: " << holes
+        << ", alloc+dealloc: " << ns << " ns/op\n";
+
+    ASSERT_EQ(buddy->used, used);
+}
+
+TEST(buddy_bench, alloc_fragmented) {
+    bench_fragmented(false);
+    bench_fragmented(true);
+}
@@ -0,0 +1,242 @@
+#include <gtest/gtest.h>
+
+extern "C" {
+#define restrict
+#include "buddy/range.h"
+};
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <random>
+#include <set>
+#include <vector>
+
+struct test_range {
+    range_allocator ra;
+    range_node_allocator na;
+    std::set<range_node*> nodes;
+    bool fail_alloc = false;
+
+    test_range(const test_range&) = delete;
+    test_range& operator =(const test_range&) = delete;
+
+    test_range(uintptr_t begin, uintptr_t end) {
+        na.ctx = this;
+        na.alloc = [](void* ctx) -> range_node* {
+            auto self = static_cast<test_range*>(ctx);
+            if (self->fail_alloc) {
+                return nullptr;
+            }
+            auto node = static_cast<range_node*>(malloc(sizeof(range_node)));
+            self->nodes.insert(node);
+            return node;
+        };
+        na.dealloc = [](void* ctx, range_node* node) {
+            auto self = static_cast<test_range*>(ctx);
+            EXPECT_EQ(self->nodes.erase(node), 1);
+            free(node);
+        };
+        EXPECT_TRUE(range_init(&ra, begin, end, &na));
+    }
+    ~test_range() {
+        range_destroy(&ra);
+        EXPECT_TRUE(nodes.empty());
+    }
+    range_allocator* get() {
+        return &ra;
+    }
+    range_allocator* operator ->() {
+        return &ra;
+    }
+};
+
+static const uintptr_t BEGIN = 0xffffff8000000000;
+static const uintptr_t PAGE = 0x1000;
+
+TEST(range_test, initializes_correctly) {
+    test_range ra(BEGIN, BEGIN + 0x100 * PAGE);
+    EXPECT_EQ(ra->free, 0x100 * PAGE);
+    EXPECT_EQ(ra->node_count, 1);
+    EXPECT_EQ(range_largest_free(ra.get()), 0x100 * PAGE);
+}
+
+TEST(range_test, allocates_first_fit) {
+    test_range ra(BEGIN, BEGIN + 0x100 * PAGE);
+    uintptr_t a, b, c;
+    ASSERT_TRUE(range_alloc(ra.get(), 4 * PAGE, &a));
+    ASSERT_TRUE(range_alloc(ra.get(), 2 * PAGE, &b));
+    ASSERT_TRUE(range_alloc(ra.get(), 8 * PAGE, &c));
+    EXPECT_EQ(a, BEGIN);
+    EXPECT_EQ(b, BEGIN + 4 * PAGE);
+    EXPECT_EQ(c, BEGIN + 6 * PAGE);
+    EXPECT_EQ(ra->free, (0x100 - 14) * PAGE);
+
+    // the hole left by a is the lowest fit for small requests but not for large ones
+    ASSERT_TRUE(range_dealloc(ra.get(), a, 4 * PAGE));
+    uintptr_t d, e;
+    ASSERT_TRUE(range_alloc(ra.get(), 5 * PAGE, &d));
+    EXPECT_EQ(d, BEGIN + 14 * PAGE);
+    ASSERT_TRUE(range_alloc(ra.get(), 3 * PAGE, &e));
+    EXPECT_EQ(e, BEGIN);
+}
+
+TEST(range_test, runs_out) {
+    test_range ra(BEGIN, BEGIN + 4 * PAGE);
+    uintptr_t a, b;
+    ASSERT_FALSE(range_alloc(ra.get(), 5 * PAGE, &a));
+    ASSERT_TRUE(range_alloc(ra.get(), 4 * PAGE, &a));
+    EXPECT_EQ(ra->node_count, 0);
+    EXPECT_EQ(range_largest_free(ra.get()), 0);
+    ASSERT_FALSE(range_alloc(ra.get(), PAGE, &b));
+    ASSERT_TRUE(range_dealloc(ra.get(), a, 4 * PAGE));
+    EXPECT_EQ(ra->node_count, 1);
+}
+
+TEST(range_test, coalesces_neighbors) {
+    test_range ra(BEGIN, BEGIN + 3 * PAGE);
+    uintptr_t a, b, c;
+    ASSERT_TRUE(range_alloc(ra.get(), PAGE, &a));
+    ASSERT_TRUE(range_alloc(ra.get(), PAGE, &b));
+    ASSERT_TRUE(range_alloc(ra.get(), PAGE, &c));
+
+    ASSERT_TRUE(range_dealloc(ra.get(), a, PAGE));
+    ASSERT_TRUE(range_dealloc(ra.get(), c, PAGE));
+    EXPECT_EQ(ra->node_count, 2);
+    EXPECT_EQ(range_largest_free(ra.get()), PAGE);
+
+    // b joins both neighbors into one range
+    ASSERT_TRUE(range_dealloc(ra.get(), b, PAGE));
+    EXPECT_EQ(ra->node_count, 1);
+    EXPECT_EQ(range_largest_free(ra.get()), 3 * PAGE);
+    EXPECT_EQ(ra->free, 3 * PAGE);
+}
+
+TEST(range_test, rejects_invalid_dealloc) {
+    test_range ra(BEGIN, BEGIN + 16 * PAGE);
+    uintptr_t a, b;
+    ASSERT_TRUE(range_alloc(ra.get(), 4 * PAGE, &a));
+    ASSERT_TRUE(range_alloc(ra.get(), 4 * PAGE, &b));
+    ASSERT_TRUE(range_dealloc(ra.get(), a, 4 * PAGE));
+
+    EXPECT_FALSE(range_dealloc(ra.get(), a, 4 * PAGE));          // double free
+    EXPECT_FALSE(range_dealloc(ra.get(), a + PAGE, PAGE));        // inside a free range
+    EXPECT_FALSE(range_dealloc(ra.get(), b, 5 * PAGE));          // runs into free space
+    EXPECT_FALSE(range_dealloc(ra.get(), BEGIN - PAGE, PAGE));    // below the window
+    EXPECT_FALSE(range_dealloc(ra.get(), BEGIN + 16 * PAGE, PAGE));  // above the window
+    EXPECT_FALSE(range_dealloc(ra.get(), b, 0));
+    EXPECT_EQ(ra->free, 12 * PAGE);
+
+    ASSERT_TRUE(range_dealloc(ra.get(), b, 4 * PAGE));
+    EXPECT_EQ(ra->node_count, 1);
+}
+
+TEST(range_test, frees_part_of_an_allocation) {
+    test_range ra(BEGIN, BEGIN + 16 * PAGE);
+    uintptr_t a;
+    ASSERT_TRUE(range_alloc(ra.get(), 8 * PAGE, &a));
+    ASSERT_TRUE(range_dealloc(ra.get(), a + 2 * PAGE, 2 * PAGE));
+    EXPECT_EQ(ra->node_count, 2);
+    // joins the freed middle part and the free space after the allocation
+    ASSERT_TRUE(range_dealloc(ra.get(), a + 4 * PAGE, 4 * PAGE));
+    EXPECT_EQ(ra->node_count, 1);
+    ASSERT_TRUE(range_dealloc(ra.get(), a, 2 * PAGE));
+    EXPECT_EQ(ra->node_count, 1);
+    EXPECT_EQ(ra->free, 16 * PAGE);
+}
+
+TEST(range_test, node_allocation_failure) {
+    test_range ra(BEGIN, BEGIN + 16 * PAGE);
+    uintptr_t a, b, c;
+    ASSERT_TRUE(range_alloc(ra.get(), PAGE, &a));
+    ASSERT_TRUE(range_alloc(ra.get(), PAGE, &b));
+    ASSERT_TRUE(range_alloc(ra.get(), PAGE, &c));
+
+    ra.fail_alloc = true;
+    // b has no free neighbor and needs a new node, c and then b and a only grow one
+    EXPECT_FALSE(range_dealloc(ra.get(), b, PAGE));
+    EXPECT_EQ(ra->free, 13 * PAGE);
+    EXPECT_TRUE(range_dealloc(ra.get(), c, PAGE));
+    EXPECT_TRUE(range_dealloc(ra.get(), b, PAGE));
+    EXPECT_TRUE(range_dealloc(ra.get(), a, PAGE));
+    EXPECT_EQ(ra->node_count, 1);
+    EXPECT_EQ(ra->free, 16 * PAGE);
+}
+
+// more free fragments than the fixed 24-node list the kernel used to have
+TEST(range_test, many_fragments) {
+    const size_t count = 4096;
+    test_range ra(BEGIN, BEGIN + count * PAGE);
+    std::vector<uintptr_t> ptrs(count);
+    for (size_t i = 0; i < count; i++) {
+        ASSERT_TRUE(range_alloc(ra.get(), PAGE, &ptrs[i]));
+        ASSERT_EQ(ptrs[i], BEGIN + i * PAGE);
+    }
+    for (size_t i = 0; i < count; i += 2) {
+        ASSERT_TRUE(range_dealloc(ra.get(), ptrs[i], PAGE));
+    }
+    EXPECT_EQ(ra->node_count, count / 2);
+    EXPECT_EQ(range_largest_free(ra.get()), PAGE);
+
+    uintptr_t p;
+    ASSERT_FALSE(range_alloc(ra.get(), 2 * PAGE, &p));
+    for (size_t i = 1; i < count; i += 2) {
+        ASSERT_TRUE(range_dealloc(ra.get(), ptrs[i], PAGE));
+    }
+    EXPECT_EQ(ra->node_count, 1);
+    EXPECT_EQ(range_largest_free(ra.get()), count * PAGE);
+}
+
+// random allocations of 1 to 16 pages checked against a page map
+TEST(range_test, random_against_page_map) {
+    const size_t pages = 1024;
+    test_range ra(BEGIN, BEGIN + pages * PAGE);
+    std::vector<bool> used(pages, false);
+    std::vector<std::pair<uintptr_t, size_t>> live;
+    std::mt19937 rng(7);
+
+    for (int op = 0; op < 20000; op++) {
+        if (live.empty() || rng() % 2 == 0) {
+            const size_t n = 1 + rng() % 16;
+            size_t expected = pages;
+            for (size_t i = 0, run = 0; i < pages; i++) {
+                run = used[i] ? 0 : run + 1;
+                if (run == n) {
+                    expected = i + 1 - n;
+                    break;
+                }
+            }
+
+            uintptr_t begin;
+            const bool ok = range_alloc(ra.get(), n * PAGE, &begin);
+            ASSERT_EQ(ok, expected != pages);
+            if (!ok) {
+                continue;
+            }
+            ASSERT_EQ(begin, BEGIN + expected * PAGE);
+            for (size_t i = 0; i < n; i++) {
+                used[expected + i] = true;
+            }
+            live.push_back({ begin, n });
+        } else {
+            const size_t k = rng() % live.size();
+            const auto [begin, n] = live[k];
+            ASSERT_TRUE(range_dealloc(ra.get(), begin, n * PAGE));
+            for (size_t i = 0; i < n; i++) {
+                used[(begin - BEGIN) / PAGE + i] = false;
+            }
+            live[k] = live.back();
+            live.pop_back();
+        }
+
+        size_t free_pages = 0, fragments = 0, largest = 0;
+        for (size_t i = 0, run = 0; i < pages; i++) {
+            run = used[i] ? 0 : run + 1;
+            free_pages += !used[i];
+            fragments += !used[i] && (i == 0 || used[i - 1]);
+            largest = std::max(largest, run);
+        }
+        ASSERT_EQ(ra->free, free_pages * PAGE);
+        ASSERT_EQ(ra->node_count, fragments);
+        ASSERT_EQ(range_largest_free(ra.get()), largest * PAGE);
+    }
+}
@@ -11,7 +11,10 @@ extern "C" {
 #include <stdio.h>
 #include <vector>
 #include <set>
+#include <map>
+#include <random>
 #include <algorithm>
+#include <string.h>
 
 struct alignas(4096) page {
     uint64_t buf[512];
@@ -20,9 +23,13 @@ struct alignas(4096) page {
 struct test_buddy {
     buddy_blocks buddy;
     std::vector<page> mem;
-    test_buddy() {
-        mem.resize(0x00200000 / 4096);
-        buddy_init(&buddy, mem.data(), mem.size() * sizeof(page));
+    explicit test_buddy(bool freelist = false, size_t len = 0x00200000) {
+        mem.resize(len / 4096);
+        if (freelist) {
+            buddy_init_freelist(&buddy, mem.data(), mem.size() * sizeof(page));
+        } else {
+            buddy_init(&buddy, mem.data(), mem.size() * sizeof(page));
+        }
     }
     buddy_blocks* get() {
         return &buddy;
@@ -32,6 +39,16 @@ struct test_buddy {
     }
 };
 
+// the pool has merged back into blocks of the top level
+static void expect_fully_coalesced(test_buddy& buddy) {
+    const size_t max_level_size = BUDDY_UNIT << (buddy->levels - 1);
+    void* ptr = buddy_alloc(buddy.get(), max_level_size);
+    EXPECT_NE(ptr, nullptr);
+    if (ptr) {
+        buddy_dealloc(buddy.get(), ptr, max_level_size);
+    }
+}
+
 TEST(buddy_test, create) {
     test_buddy buddy;
 
@@ -40,11 +57,11 @@ TEST(buddy_test, create) {
 
     const size_t units = 0x1ff000 / BUDDY_UNIT;
     size_t level = 0;
-    size_t bitlen = 0;
+    size_t wordlen = 0;
     for (; units >> level; level++) {
-        bitlen += ((units >> level) + 7) / 8;
+        wordlen += ((units >> level) + 63) / 64;
     }
-    const size_t metalen = level * 16 + bitlen;
+    const size_t metalen = level * 40 + wordlen * 8;
 
     ASSERT_EQ(buddy->start_addr, begin);
     ASSERT_EQ(buddy->total_len, len);
@@ -730,3 +747,466 @@ TEST(buddy_test, alloc_slice_exact_power_of_two) {
     ASSERT_EQ(buddy->used, 0);
 }
 
+
+TEST(buddy_freelist_test, same_layout_as_bitmap) {
+    test_buddy bitmap;
+    test_buddy freelist(true);
+
+    ASSERT_TRUE(freelist->freelist);
+    ASSERT_FALSE(bitmap->freelist);
+    ASSERT_EQ(freelist->metadata_len, bitmap->metadata_len);
+    ASSERT_EQ(freelist->data_offset, bitmap->data_offset);
+    ASSERT_EQ(freelist->units, bitmap->units);
+    ASSERT_EQ(freelist->levels, bitmap->levels);
+    ASSERT_EQ(freelist->used, 0);
+}
+
+TEST(buddy_freelist_test, seq) {
+    test_buddy buddy(true);
+
+    for (size_t level = 0; level < buddy->levels; level++) {
+        const size_t block_count = buddy->units >> level;
+        const size_t size = BUDDY_UNIT << level;
+
+        std::vector<void*> ptrs;
+        for (size_t index = 0; index < block_count; index++) {
+            void* ptr = buddy_alloc(buddy.get(), size);
+            ASSERT_NE(ptr, nullptr);
+            memset(ptr, (int)index, size);
+            ptrs.push_back(ptr);
+        }
+
+        ASSERT_EQ(buddy->used, (buddy->total_len - buddy->data_offset) / size * size);
+        ASSERT_EQ(buddy_alloc(buddy.get(), size), nullptr);
+
+        for (void* ptr : ptrs) {
+            buddy_dealloc(buddy.get(), ptr, size);
+        }
+
+        ASSERT_EQ(buddy->used, 0);
+    }
+}
+
+TEST(buddy_freelist_test, exhaustion_matches_bitmap) {
+    for (size_t level = 0; level < 4; level++) {
+        const size_t size = BUDDY_UNIT << level;
+        test_buddy bitmap;
+        test_buddy freelist(true);
+
+        std::set<void*> ptrs_bitmap, ptrs_freelist;
+        while (void* ptr = buddy_alloc(bitmap.get(), size)) {
+            ptrs_bitmap.insert(ptr);
+        }
+        while (void* ptr = buddy_alloc(freelist.get(), size)) {
+            ptrs_freelist.insert((void*)((uintptr_t)ptr - freelist->start_addr + bitmap->start_addr));
+        }
+
+        ASSERT_EQ(ptrs_freelist, ptrs_bitmap);
+        ASSERT_EQ(freelist->used, bitmap->used);
+
+        for (void* ptr : ptrs_freelist) {
+            buddy_dealloc(freelist.get(), (void*)((uintptr_t)ptr - bitmap->start_addr + freelist->start_addr), size);
+        }
+        ASSERT_EQ(freelist->used, 0);
+    }
+}
+
+TEST(buddy_freelist_test, sequential_allocs_match_bitmap) {
+    test_buddy bitmap;
+    test_buddy freelist(true);
+
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<size_t> dist_len(1, 8 * BUDDY_UNIT);
+
+    for (int round = 0; round < 4; round++) {
+        // from a fully coalesced state, both engines hold at most one free block per level,
+        // so a run of allocations must pick the same blocks
+        std::vector<std::pair<uintptr_t, size_t>> offsets;
+        while (true) {
+            const size_t len = dist_len(rng);
+            slice a = buddy_alloc_slice(bitmap.get(), len);
+            slice b = buddy_alloc_slice(freelist.get(), len);
+            ASSERT_EQ(a.length, b.length);
+            if (!a.ptr) {
+                ASSERT_EQ(b.ptr, nullptr);
+                break;
+            }
+            const uintptr_t offset_a = (uintptr_t)a.ptr - bitmap->start_addr;
+            const uintptr_t offset_b = (uintptr_t)b.ptr - freelist->start_addr;
+            ASSERT_EQ(offset_a, offset_b);
+            offsets.push_back({ offset_a, a.length });
+        }
+        ASSERT_EQ(freelist->used, bitmap->used);
+
+        std::shuffle(offsets.begin(), offsets.end(), rng);
+        for (auto [offset, len] : offsets) {
+            buddy_dealloc(bitmap.get(), (void*)(bitmap->start_addr + offset), len);
+            buddy_dealloc(freelist.get(), (void*)(freelist->start_addr + offset), len);
+            ASSERT_EQ(freelist->used, bitmap->used);
+        }
+        ASSERT_EQ(freelist->used, 0);
+    }
+}
+
+TEST(buddy_freelist_test, random_interleaved_no_overlap) {
+    test_buddy buddy(true);
+
+    std::mt19937 rng(5678);
+    std::map<uintptr_t, size_t> live;
+
+    for (int i = 0; i < 5000; i++) {
+        if (live.empty() || rng() % 3 != 0) {
+            const size_t len = BUDDY_UNIT << (rng() % 5);
+            slice s = buddy_alloc_slice(buddy.get(), len);
+            if (!s.ptr) {
+                continue;
+            }
+            const uintptr_t addr = (uintptr_t)s.ptr;
+            ASSERT_EQ((addr - buddy->start_addr - buddy->data_offset) % s.length, 0);
+
+            auto next = live.lower_bound(addr);
+            if (next != live.end()) {
+                ASSERT_LE(addr + s.length, next->first);
+            }
+            if (next != live.begin()) {
+                auto prev = std::prev(next);
+                ASSERT_LE(prev->first + prev->second, addr);
+            }
+            live[addr] = s.length;
+        } else {
+            auto it = live.begin();
+            std::advance(it, rng() % live.size());
+            buddy_dealloc(buddy.get(), (void*)it->first, it->second);
+            live.erase(it);
+        }
+    }
+
+    for (auto [addr, len] : live) {
+        buddy_dealloc(buddy.get(), (void*)addr, len);
+    }
+    ASSERT_EQ(buddy->used, 0);
+    expect_fully_coalesced(buddy);
+}
+
+// runs every test on both the bitmap and the freelist engine
+class buddy_engine_test : public testing::TestWithParam<bool> {
+protected:
+    test_buddy buddy{ GetParam() };
+};
+
+static std::string engine_param_name(const testing::TestParamInfo<bool>& info) {
+    return info.param ? "freelist" : "bitmap";
+}
+
+INSTANTIATE_TEST_SUITE_P(engines, buddy_engine_test, testing::Bool(), engine_param_name);
+
+TEST_P(buddy_engine_test, bulk_alloc_and_dealloc) {
+    for (size_t order = 0; order < 4; order++) {
+        const size_t size = BUDDY_UNIT << order;
+        for (size_t n : { 1, 3, 8, 13, 40 }) {
+            std::vector<void*> ptrs(n);
+            ASSERT_EQ(buddy_alloc_bulk(buddy.get(), order, n, ptrs.data()), n);
+            ASSERT_EQ(buddy->used, n * size);
+
+            std::set<void*> unique(ptrs.begin(), ptrs.end());
+            ASSERT_EQ(unique.size(), n);
+            for (void* ptr : ptrs) {
+                const uintptr_t offset = (uintptr_t)ptr - buddy->start_addr - buddy->data_offset;
+                ASSERT_EQ(offset % size, 0);
+                ASSERT_LE(offset + size, buddy->total_len - buddy->data_offset);
+                memset(ptr, 0xab, size);
+            }
+
+            buddy_dealloc_bulk(buddy.get(), order, n, ptrs.data());
+            ASSERT_EQ(buddy->used, 0);
+        }
+    }
+
+    expect_fully_coalesced(buddy);
+}
+
+TEST_P(buddy_engine_test, bulk_splits_one_large_block) {
+    // a coalesced pool has a free block of 8 units, which is handed out as is
+    std::vector<void*> ptrs(8);
+    ASSERT_EQ(buddy_alloc_bulk(buddy.get(), 0, ptrs.size(), ptrs.data()), ptrs.size());
+    for (size_t i = 1; i < ptrs.size(); i++) {
+        ASSERT_EQ((uintptr_t)ptrs[i], (uintptr_t)ptrs[i - 1] + BUDDY_UNIT);
+    }
+
+    // pieces can be freed one at a time
+    for (void* ptr : ptrs) {
+        buddy_dealloc(buddy.get(), ptr, BUDDY_UNIT);
+    }
+    ASSERT_EQ(buddy->used, 0);
+}
+
+TEST_P(buddy_engine_test, bulk_partial_on_exhaustion) {
+    std::vector<void*> ptrs(buddy->units + 10);
+    const size_t count = buddy_alloc_bulk(buddy.get(), 0, ptrs.size(), ptrs.data());
+    ASSERT_EQ(count, buddy->units);
+    ASSERT_EQ(buddy_alloc(buddy.get(), BUDDY_UNIT), nullptr);
+
+    buddy_dealloc_bulk(buddy.get(), 0, count, ptrs.data());
+    ASSERT_EQ(buddy->used, 0);
+
+    ASSERT_EQ(buddy_alloc_bulk(buddy.get(), buddy->levels, 1, ptrs.data()), 0);
+}
+
+TEST_P(buddy_engine_test, bulk_random_operations) {
+    std::mt19937 rng(42);
+    std::vector<std::pair<size_t, std::vector<void*>>> live;
+    for (int i = 0; i < 200; i++) {
+        if (live.empty() || rng() % 3 != 0) {
+            const size_t order = rng() % 3;
+            const size_t n = rng() % 20 + 1;
+            std::vector<void*> ptrs(n);
+            const size_t count = buddy_alloc_bulk(buddy.get(), order, n, ptrs.data());
+            ptrs.resize(count);
+            if (count < n) {
+                // bulk allocation stops only when no block of the order is left
+                ASSERT_EQ(buddy_alloc(buddy.get(), BUDDY_UNIT << order), nullptr);
+            }
+            live.push_back({ order, std::move(ptrs) });
+        } else {
+            const size_t idx = rng() % live.size();
+            auto& [order, ptrs] = live[idx];
+            buddy_dealloc_bulk(buddy.get(), order, ptrs.size(), ptrs.data());
+            live.erase(live.begin() + idx);
+        }
+    }
+
+    for (auto& [order, ptrs] : live) {
+        buddy_dealloc_bulk(buddy.get(), order, ptrs.size(), ptrs.data());
+    }
+    ASSERT_EQ(buddy->used, 0);
+}
+
+TEST_P(buddy_engine_test, exact_tail_is_returned) {
+    // 5 units take an 8-unit block, the 3-unit tail goes back to the pool
+    slice s = buddy_alloc_exact(buddy.get(), BUDDY_UNIT * 5 - 100);
+    ASSERT_NE(s.ptr, nullptr);
+    ASSERT_EQ(s.length, BUDDY_UNIT * 5);
+    ASSERT_EQ(buddy->used, BUDDY_UNIT * 5);
+    memset(s.ptr, 0xab, s.length);
+
+    // the tail is the next thing handed out
+    void* tail1 = buddy_alloc(buddy.get(), BUDDY_UNIT);
+    void* tail2 = buddy_alloc(buddy.get(), BUDDY_UNIT * 2);
+    ASSERT_EQ((uintptr_t)tail1, (uintptr_t)s.ptr + BUDDY_UNIT * 5);
+    ASSERT_EQ((uintptr_t)tail2, (uintptr_t)s.ptr + BUDDY_UNIT * 6);
+
+    buddy_dealloc(buddy.get(), tail1, BUDDY_UNIT);
+    buddy_dealloc(buddy.get(), tail2, BUDDY_UNIT * 2);
+    buddy_dealloc_exact(buddy.get(), s.ptr, BUDDY_UNIT * 5 - 100);
+    ASSERT_EQ(buddy->used, 0);
+
+    expect_fully_coalesced(buddy);
+}
+
+TEST_P(buddy_engine_test, exact_too_large) {
+    const size_t max_level_size = BUDDY_UNIT << (buddy->levels - 1);
+    ASSERT_EQ(buddy_alloc_exact(buddy.get(), max_level_size + 1).ptr, nullptr);
+    ASSERT_NE(buddy_alloc_exact(buddy.get(), max_level_size - BUDDY_UNIT).ptr, nullptr);
+    ASSERT_EQ(buddy->used, max_level_size - BUDDY_UNIT);
+}
+
+TEST_P(buddy_engine_test, exact_partial_dealloc) {
+    // a block can be given back piece by piece, in any order
+    void* ptr = buddy_alloc(buddy.get(), BUDDY_UNIT * 16);
+    ASSERT_NE(ptr, nullptr);
+    buddy_dealloc_exact(buddy.get(), (char*)ptr + BUDDY_UNIT * 3, BUDDY_UNIT * 10);
+    ASSERT_EQ(buddy->used, BUDDY_UNIT * 6);
+    buddy_dealloc_exact(buddy.get(), (char*)ptr + BUDDY_UNIT * 13, BUDDY_UNIT * 3);
+    buddy_dealloc_exact(buddy.get(), ptr, BUDDY_UNIT * 3);
+    ASSERT_EQ(buddy->used, 0);
+
+    void* again = buddy_alloc(buddy.get(), BUDDY_UNIT * 16);
+    ASSERT_EQ(again, ptr);
+    buddy_dealloc(buddy.get(), again, BUDDY_UNIT * 16);
+}
+
+TEST_P(buddy_engine_test, exact_random_no_overlap) {
+    std::mt19937 rng(7);
+    std::map<uintptr_t, size_t> live;
+    for (int i = 0; i < 2000; i++) {
+        if (live.empty() || rng() % 3 != 0) {
+            const size_t len = rng() % (BUDDY_UNIT * 37) + 1;
+            slice s = buddy_alloc_exact(buddy.get(), len);
+            if (!s.ptr) {
+                continue;
+            }
+            ASSERT_EQ(s.length, (len + BUDDY_UNIT - 1) / BUDDY_UNIT * BUDDY_UNIT);
+
+            const uintptr_t addr = (uintptr_t)s.ptr;
+            auto next = live.lower_bound(addr);
+            if (next != live.end()) {
+                ASSERT_LE(addr + s.length, next->first);
+            }
+            if (next != live.begin()) {
+                auto prev = std::prev(next);
+                ASSERT_LE(prev->first + prev->second, addr);
+            }
+            live[addr] = s.length;
+        } else {
+            auto it = live.begin();
+            std::advance(it, rng() % live.size());
+            buddy_dealloc_exact(buddy.get(), (void*)it->first, it->second);
+            live.erase(it);
+        }
+
+        size_t used = 0;
+        for (auto& [addr, len] : live) {
+            used += len;
+        }
+        ASSERT_EQ(buddy->used, used);
+    }
+
+    for (auto& [addr, len] : live) {
+        buddy_dealloc_exact(buddy.get(), (void*)addr, len);
+    }
+    ASSERT_EQ(buddy->used, 0);
+}
+
+TEST_P(buddy_engine_test, constrained_alignment) {
+    // alignment is of the address itself, not of the offset from the pool
+    for (size_t align : { (size_t)BUDDY_UNIT, (size_t)BUDDY_UNIT * 4, (size_t)0x10000, (size_t)0x40000 }) {
+        slice s = buddy_alloc_constrained(buddy.get(), BUDDY_UNIT * 3, align, 0, UINTPTR_MAX);
+        ASSERT_NE(s.ptr, nullptr);
+        ASSERT_EQ((uintptr_t)s.ptr % align, 0);
+        ASSERT_EQ(s.length, BUDDY_UNIT * 3);
+        ASSERT_EQ(buddy->used, BUDDY_UNIT * 3);
+        memset(s.ptr, 0xab, s.length);
+
+        buddy_dealloc_exact(buddy.get(), s.ptr, s.length);
+        ASSERT_EQ(buddy->used, 0);
+    }
+
+    expect_fully_coalesced(buddy);
+}
+
+TEST_P(buddy_engine_test, constrained_window) {
+    const uintptr_t data_addr = buddy->start_addr + buddy->data_offset;
+    const uintptr_t lo = data_addr + BUDDY_UNIT * 100;
+    const uintptr_t hi = data_addr + BUDDY_UNIT * 120;
+
+    // the window takes exactly 20 units
+    std::vector<void*> ptrs;
+    while (true) {
+        slice s = buddy_alloc_constrained(buddy.get(), BUDDY_UNIT, 1, lo, hi);
+        if (!s.ptr) {
+            break;
+        }
+        ASSERT_GE((uintptr_t)s.ptr, lo);
+        ASSERT_LE((uintptr_t)s.ptr + s.length, hi);
+        ptrs.push_back(s.ptr);
+    }
+    ASSERT_EQ(ptrs.size(), 20);
+    ASSERT_EQ(buddy->used, BUDDY_UNIT * 20);
+
+    // too large for the window, or no window at all
+    ASSERT_EQ(buddy_alloc_constrained(buddy.get(), BUDDY_UNIT * 21, 1, data_addr, data_addr + BUDDY_UNIT * 20).ptr, nullptr);
+    ASSERT_EQ(buddy_alloc_constrained(buddy.get(), BUDDY_UNIT, 1, 0, data_addr).ptr, nullptr);
+
+    // the rest of the pool is untouched
+    void* other = buddy_alloc(buddy.get(), BUDDY_UNIT * 64);
+    ASSERT_NE(other, nullptr);
+    buddy_dealloc(buddy.get(), other, BUDDY_UNIT * 64);
+
+    for (void* ptr : ptrs) {
+        buddy_dealloc_exact(buddy.get(), ptr, BUDDY_UNIT);
+    }
+    ASSERT_EQ(buddy->used, 0);
+}
+
+TEST_P(buddy_engine_test, constrained_random_no_overlap) {
+    const uintptr_t data_addr = buddy->start_addr + buddy->data_offset;
+    const size_t data_len = buddy->units * BUDDY_UNIT;
+
+    std::mt19937 rng(11);
+    std::map<uintptr_t, size_t> live;
+    for (int i = 0; i < 2000; i++) {
+        if (live.empty() || rng() % 3 != 0) {
+            const size_t len = rng() % (BUDDY_UNIT * 20) + 1;
+            const size_t align = (size_t)BUDDY_UNIT << (rng() % 6);
+            const uintptr_t lo = data_addr + rng() % data_len;
+            const uintptr_t hi = lo + rng() % (data_len / 4);
+            slice s = buddy_alloc_constrained(buddy.get(), len, align, lo, hi);
+            if (!s.ptr) {
+                continue;
+            }
+
+            const uintptr_t addr = (uintptr_t)s.ptr;
+            ASSERT_EQ(addr % align, 0);
+            ASSERT_GE(addr, lo);
+            ASSERT_LE(addr + s.length, hi);
+
+            auto next = live.lower_bound(addr);
+            if (next != live.end()) {
+                ASSERT_LE(addr + s.length, next->first);
+            }
+            if (next != live.begin()) {
+                auto prev = std::prev(next);
+                ASSERT_LE(prev->first + prev->second, addr);
+            }
+            live[addr] = s.length;
+        } else {
+            auto it = live.begin();
+            std::advance(it, rng() % live.size());
+            buddy_dealloc_exact(buddy.get(), (void*)it->first, it->second);
+            live.erase(it);
+        }
+    }
+
+    for (auto& [addr, len] : live) {
+        buddy_dealloc_exact(buddy.get(), (void*)addr, len);
+    }
+    ASSERT_EQ(buddy->used, 0);
+
+    expect_fully_coalesced(buddy);
+}
+
+TEST_P(buddy_engine_test, stats_fresh_pool) {
+    buddy_stats stats;
+    buddy_get_stats(buddy.get(), &stats);
+
+    ASSERT_EQ(stats.units, buddy->units);
+    ASSERT_EQ(stats.levels, buddy->levels);
+    ASSERT_EQ(stats.used, 0);
+    ASSERT_EQ(stats.free, buddy->units * BUDDY_UNIT);
+    ASSERT_EQ(stats.largest_free, (size_t)BUDDY_UNIT << (buddy->levels - 1));
+
+    size_t free = 0;
+    for (size_t order = 0; order < BUDDY_STATS_LEVELS; order++) {
+        free += stats.free_blocks[order] * ((size_t)BUDDY_UNIT << order);
+    }
+    ASSERT_EQ(free, stats.free);
+}
+
+TEST_P(buddy_engine_test, stats_fragmentation) {
+    buddy_stats before;
+    buddy_get_stats(buddy.get(), &before);
+
+    // every other unit allocated leaves only single free units
+    std::vector<void*> ptrs;
+    while (void* ptr = buddy_alloc(buddy.get(), BUDDY_UNIT)) {
+        ptrs.push_back(ptr);
+    }
+    for (size_t i = 0; i < ptrs.size(); i += 2) {
+        buddy_dealloc(buddy.get(), ptrs[i], BUDDY_UNIT);
+    }
+
+    buddy_stats stats;
+    buddy_get_stats(buddy.get(), &stats);
+    ASSERT_EQ(stats.used + stats.free, before.free);
+    ASSERT_EQ(stats.largest_free, BUDDY_UNIT);
+    ASSERT_EQ(stats.free_blocks[0], stats.free / BUDDY_UNIT);
+    ASSERT_GT(stats.fragmentation, before.fragmentation);
+    ASSERT_GT(stats.fragmentation, 900);
+
+    for (size_t i = 1; i < ptrs.size(); i += 2) {
+        buddy_dealloc(buddy.get(), ptrs[i], BUDDY_UNIT);
+    }
+    buddy_get_stats(buddy.get(), &stats);
+    ASSERT_EQ(stats.free, before.free);
+    ASSERT_EQ(stats.fragmentation, before.fragmentation);
+}
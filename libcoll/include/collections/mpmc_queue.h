@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdalign.h>
+
+#define MPMC_QUEUE_CACHELINE 64
+
+// bytes per slot: a sequence number followed by the element, padded to keep the sequence aligned
+#define MPMC_QUEUE_SLOT_SIZE(elem_size) \
+    ((sizeof(size_t) + (elem_size) + alignof(size_t) - 1) / alignof(size_t) * alignof(size_t))
+
+// bounded queue that any number of producers and consumers may use concurrently (Vyukov's design).
+// each slot carries a sequence number that says whose turn it is: pos when free for the producer
+// claiming position pos, pos + 1 when filled for the consumer of pos. producers and consumers only
+// contend on their own position counter, each on its own cache line. maxlen must be a power of two.
+struct mpmc_queue {
+    char* slots;
+    size_t slot_size;
+    size_t elem_size;
+    size_t mask;
+
+    alignas(MPMC_QUEUE_CACHELINE) size_t enqueue_pos;
+    alignas(MPMC_QUEUE_CACHELINE) size_t dequeue_pos;
+};
+
+// slots holds maxlen * MPMC_QUEUE_SLOT_SIZE(elem_size) bytes aligned for size_t
+void mpmc_queue_init(struct mpmc_queue* q, void* slots, size_t elem_size, size_t maxlen);
+size_t mpmc_queue_maxlen(const struct mpmc_queue* q);
+
+// return false when the queue is full or empty, never block
+bool mpmc_queue_push(struct mpmc_queue* q, const void* elem);
+bool mpmc_queue_pop(struct mpmc_queue* q, void* elem);
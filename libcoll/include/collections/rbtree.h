@@ -1,5 +1,9 @@
 #pragma once
 
+#include <stdbool.h>
+
+// nodes are ordered by key unless the tree has a compare op, in which case key is unused and
+// nodes are usually embedded in a larger struct that holds the real key (see container_of)
 struct rbtree_node {
     struct rbtree_node* parent;
     struct rbtree_node* left;
@@ -8,8 +12,18 @@ struct rbtree_node {
     int key;
 };
 
+struct rbtree_ops {
+    // <0, 0 or >0 as lhs orders before, equal to or after rhs
+    int (*compare)(const struct rbtree_node* lhs, const struct rbtree_node* rhs);
+    // recomputes the data node keeps about its subtree (e.g. the max end of intervals below it)
+    // from the node itself and its children. the tree calls it whenever a subtree changes, children
+    // before parents.
+    void (*augment)(struct rbtree_node* node);
+};
+
 struct rbtree {
     struct rbtree_node* root;
+    const struct rbtree_ops* ops;
 };
 
 struct rbtree_find_result {
@@ -19,8 +33,20 @@ struct rbtree_find_result {
 };
 
 void rbtree_init(struct rbtree* tree);
+// ops may be NULL, either op may be NULL
+void rbtree_init_ops(struct rbtree* tree, const struct rbtree_ops* ops);
+// by int key, only for trees without a compare op
 struct rbtree_find_result rbtree_find(struct rbtree* tree, int key);
+// compare(key, node) orders an arbitrary key against node like the compare op orders nodes
+struct rbtree_find_result rbtree_find_by(struct rbtree* tree, const void* key,
+    int (*compare)(const void* key, const struct rbtree_node* node));
 struct rbtree_node* rbtree_first(struct rbtree* tree);
+struct rbtree_node* rbtree_last(struct rbtree* tree);
 struct rbtree_node* rbtree_next(struct rbtree_node* node);
-void rbtree_insert(struct rbtree* tree, struct rbtree_node* node);
+struct rbtree_node* rbtree_prev(struct rbtree_node* node);
+// returns false without inserting if a node with an equal key is in the tree
+bool rbtree_insert(struct rbtree* tree, struct rbtree_node* node);
 void rbtree_remove(struct rbtree* tree, struct rbtree_node* node);
+// after changing the data of a node in place without changing its order, recompute its
+// augmented data and that of its ancestors
+void rbtree_augment_update(struct rbtree* tree, struct rbtree_node* node);
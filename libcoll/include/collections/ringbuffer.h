@@ -3,12 +3,15 @@
 #include <stddef.h>
 #include <stdbool.h>
 
+// head and tail are element indices in [0, maxlen), which wrap by comparison. when maxlen is a power
+// of two, mask = maxlen - 1 and push_n/pop_n wrap with it, otherwise mask is 0.
 struct ringbuffer {
     char* buffer;
     size_t head;
     size_t tail;
     size_t count;
     size_t maxlen;
+    size_t mask;
 };
 
 void ringbuffer_init(struct ringbuffer* rb, void* buffer, size_t maxlen);
@@ -21,3 +24,15 @@ size_t ringbuffer_pop_index(struct ringbuffer* rb);
 #define ringbuffer_push(rb, type, val) (*(type*)((rb)->buffer + ringbuffer_push_index(rb) * sizeof(type)) = (val))
 
 #define ringbuffer_pop(rb, type) (*(type*)((rb)->buffer + ringbuffer_pop_index(rb) * sizeof(type)))
+
+// copy up to n elements of elem_size bytes in or out, returns the count copied
+size_t ringbuffer_push_n(struct ringbuffer* rb, const void* src, size_t elem_size, size_t n);
+size_t ringbuffer_pop_n(struct ringbuffer* rb, void* dest, size_t elem_size, size_t n);
+
+// zero-copy access: the contiguous span of readable elements at head, or of writable elements at
+// tail, starting at *index. returns its length, which can be less than count or free space when the
+// span wraps. consume or commit at most that many afterwards.
+size_t ringbuffer_peek(struct ringbuffer* rb, size_t* index);
+void ringbuffer_consume(struct ringbuffer* rb, size_t n);
+size_t ringbuffer_reserve(struct ringbuffer* rb, size_t* index);
+void ringbuffer_commit(struct ringbuffer* rb, size_t n);
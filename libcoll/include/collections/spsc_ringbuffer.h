@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdalign.h>
+
+#define SPSC_RINGBUFFER_CACHELINE 64
+
+// ringbuffer with one producer and one consumer that may run concurrently, e.g. an interrupt
+// handler pushing while the main loop pops. indices run freely and wrap with a mask, so maxlen
+// must be a power of two. each side keeps a cached copy of the other side's index and only
+// reloads it when the cached one says full or empty.
+struct spsc_ringbuffer {
+    char* buffer;
+    size_t elem_size;
+    size_t mask;
+
+    // written by the consumer only
+    alignas(SPSC_RINGBUFFER_CACHELINE) size_t head;
+    size_t tail_cache;
+
+    // written by the producer only
+    alignas(SPSC_RINGBUFFER_CACHELINE) size_t tail;
+    size_t head_cache;
+};
+
+void spsc_ringbuffer_init(struct spsc_ringbuffer* rb, void* buffer, size_t elem_size, size_t maxlen);
+size_t spsc_ringbuffer_maxlen(const struct spsc_ringbuffer* rb);
+// a snapshot, exact only when called from the producer or the consumer with the other side idle
+size_t spsc_ringbuffer_count(const struct spsc_ringbuffer* rb);
+bool spsc_ringbuffer_is_empty(const struct spsc_ringbuffer* rb);
+
+// producer side, returns false when full
+bool spsc_ringbuffer_push(struct spsc_ringbuffer* rb, const void* elem);
+// consumer side, returns false when empty
+bool spsc_ringbuffer_pop(struct spsc_ringbuffer* rb, void* elem);
+// consumer side, pops up to n elements and returns the count
+size_t spsc_ringbuffer_pop_n(struct spsc_ringbuffer* rb, void* elems, size_t n);
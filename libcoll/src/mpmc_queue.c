@@ -0,0 +1,78 @@
+#include <freec/string.h>
+#include <freec/assert.h>
+
+#include "collections/mpmc_queue.h"
+
+static size_t* slot_seq(struct mpmc_queue* q, size_t pos) {
+    return (size_t*)(q->slots + (pos & q->mask) * q->slot_size);
+}
+
+static void* slot_data(size_t* seq) {
+    return seq + 1;
+}
+
+void mpmc_queue_init(struct mpmc_queue* q, void* slots, size_t elem_size, size_t maxlen) {
+    assert(maxlen > 0 && (maxlen & (maxlen - 1)) == 0, "mpmc queue length must be a power of two");
+    assert((uintptr_t)slots % alignof(size_t) == 0, "mpmc queue slots are misaligned");
+    q->slots = slots;
+    q->slot_size = MPMC_QUEUE_SLOT_SIZE(elem_size);
+    q->elem_size = elem_size;
+    q->mask = maxlen - 1;
+    for (size_t pos = 0; pos < maxlen; pos++) {
+        *slot_seq(q, pos) = pos;
+    }
+    q->enqueue_pos = 0;
+    q->dequeue_pos = 0;
+}
+
+size_t mpmc_queue_maxlen(const struct mpmc_queue* q) {
+    return q->mask + 1;
+}
+
+bool mpmc_queue_push(struct mpmc_queue* q, const void* elem) {
+    size_t pos = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED);
+    size_t* seq;
+    while (1) {
+        seq = slot_seq(q, pos);
+        const intptr_t diff = (intptr_t)(__atomic_load_n(seq, __ATOMIC_ACQUIRE) - pos);
+        if (diff == 0) {
+            // the slot is free for pos: claim it, or retry with the position that beat us
+            if (__atomic_compare_exchange_n(&q->enqueue_pos, &pos, pos + 1, true,
+                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // the consumer of the previous lap has not emptied the slot yet
+            return false;
+        } else {
+            pos = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+    memcpy(slot_data(seq), elem, q->elem_size);
+    __atomic_store_n(seq, pos + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool mpmc_queue_pop(struct mpmc_queue* q, void* elem) {
+    size_t pos = __atomic_load_n(&q->dequeue_pos, __ATOMIC_RELAXED);
+    size_t* seq;
+    while (1) {
+        seq = slot_seq(q, pos);
+        const intptr_t diff = (intptr_t)(__atomic_load_n(seq, __ATOMIC_ACQUIRE) - (pos + 1));
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&q->dequeue_pos, &pos, pos + 1, true,
+                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // the producer of pos has not filled the slot yet
+            return false;
+        } else {
+            pos = __atomic_load_n(&q->dequeue_pos, __ATOMIC_RELAXED);
+        }
+    }
+    memcpy(elem, slot_data(seq), q->elem_size);
+    // free the slot for the producer one lap ahead
+    __atomic_store_n(seq, pos + q->mask + 1, __ATOMIC_RELEASE);
+    return true;
+}
@@ -8,6 +8,7 @@
 enum { RED, BLK };
 
 static struct rbtree_node* get_min_node(struct rbtree_node* node);
+static struct rbtree_node* get_max_node(struct rbtree_node* node);
 static void rotate_left(struct rbtree* tree, struct rbtree_node* node);
 static void rotate_right(struct rbtree* tree, struct rbtree_node* node);
 
@@ -30,8 +31,37 @@ static struct rbtree_node* get_sibling(struct rbtree_node* node) {
     return node == parent->left ? parent->right : parent->left;
 }
 
+static int compare_nodes(const struct rbtree* tree, const struct rbtree_node* lhs, const struct rbtree_node* rhs) {
+    if (tree->ops != NULL && tree->ops->compare != NULL) {
+        return tree->ops->compare(lhs, rhs);
+    }
+    return (lhs->key > rhs->key) - (lhs->key < rhs->key);
+}
+
+static void augment_node(struct rbtree* tree, struct rbtree_node* node) {
+    if (tree->ops != NULL && tree->ops->augment != NULL) {
+        tree->ops->augment(node);
+    }
+}
+
+// recompute node and all of its ancestors
+static void augment_path(struct rbtree* tree, struct rbtree_node* node) {
+    if (tree->ops == NULL || tree->ops->augment == NULL) {
+        return;
+    }
+    for (; node != NULL; node = node->parent) {
+        tree->ops->augment(node);
+    }
+}
+
 void rbtree_init(struct rbtree* tree) {
     tree->root = NULL;
+    tree->ops = NULL;
+}
+
+void rbtree_init_ops(struct rbtree* tree, const struct rbtree_ops* ops) {
+    tree->root = NULL;
+    tree->ops = ops;
 }
 
 struct rbtree_find_result rbtree_find(struct rbtree* tree, int key) {
@@ -59,10 +89,38 @@ struct rbtree_find_result rbtree_find(struct rbtree* tree, int key) {
     }
 }
 
+struct rbtree_find_result rbtree_find_by(struct rbtree* tree, const void* key,
+    int (*compare)(const void* key, const struct rbtree_node* node)
+) {
+    struct rbtree_find_result result = { .lower = NULL, .upper = NULL, .to_insert = NULL };
+    struct rbtree_node* next = tree->root;
+    while (next != NULL) {
+        struct rbtree_node* node = next;
+        const int order = compare(key, node);
+        if (order > 0) {
+            result.lower = node;
+            next = node->right;
+        } else if (order < 0) {
+            result.upper = node;
+            next = node->left;
+        } else {
+            result.lower = result.upper = node;
+            result.to_insert = NULL;
+            return result;
+        }
+        result.to_insert = node;
+    }
+    return result;
+}
+
 struct rbtree_node* rbtree_first(struct rbtree* tree) {
     return tree->root == NULL ? NULL : get_min_node(tree->root);
 }
 
+struct rbtree_node* rbtree_last(struct rbtree* tree) {
+    return tree->root == NULL ? NULL : get_max_node(tree->root);
+}
+
 struct rbtree_node* rbtree_next(struct rbtree_node* node) {
     if (node->right != NULL) {
         return get_min_node(node->right);
@@ -80,27 +138,52 @@ struct rbtree_node* rbtree_next(struct rbtree_node* node) {
     }
 }
 
-void rbtree_insert(struct rbtree* tree, struct rbtree_node* node) {
+struct rbtree_node* rbtree_prev(struct rbtree_node* node) {
+    if (node->left != NULL) {
+        return get_max_node(node->left);
+    }
+
+    while (1) {
+        struct rbtree_node* parent = node->parent;
+        if (parent == NULL) {
+            return NULL;
+        } else if (parent->right == node) {
+            return parent;
+        } else {
+            node = parent;
+        }
+    }
+}
+
+bool rbtree_insert(struct rbtree* tree, struct rbtree_node* node) {
+    node->left = node->right = NULL;
     if (tree->root == NULL) {
         node->parent = NULL;
-        node->left = node->right = NULL;
         node->color = BLK;
         tree->root = node;
-    } else {
-        struct rbtree_find_result r = rbtree_find(tree, node->key);
-        if (r.to_insert == NULL) {
-            return;
-        } else {
-            node->parent = r.to_insert;
-            node->left = node->right = NULL;
-            if (node->key < r.to_insert->key) {
-                r.to_insert->left = node;
-            } else {
-                r.to_insert->right = node;
-            }
-            insertion_balancing(tree, node);
+        augment_node(tree, node);
+        return true;
+    }
+
+    struct rbtree_node* parent = tree->root;
+    while (1) {
+        const int order = compare_nodes(tree, node, parent);
+        if (order == 0) {
+            return false;
         }
+        struct rbtree_node** link = order < 0 ? &parent->left : &parent->right;
+        if (*link == NULL) {
+            *link = node;
+            break;
+        }
+        parent = *link;
     }
+    node->parent = parent;
+
+    // rotations keep the data of the rest of the tree valid once the new path is augmented
+    augment_path(tree, node);
+    insertion_balancing(tree, node);
+    return true;
 }
 
 static void insertion_balancing(struct rbtree* tree, struct rbtree_node* node) {
@@ -165,6 +248,8 @@ void rbtree_remove(struct rbtree* tree, struct rbtree_node* node) {
         // case 0: node has two non-null children
         struct rbtree_node* successor = get_min_node(node->right);
         rbtree_remove(tree, successor);
+        // rebalancing after that removal may rotate node under a new parent
+        parent = node->parent;
 
         if (parent != NULL) {
             if (parent->left == node) {
@@ -188,6 +273,7 @@ void rbtree_remove(struct rbtree* tree, struct rbtree_node* node) {
         if (tree->root == node) {
             tree->root = successor;
         }
+        augment_path(tree, successor);
     } else {
         // replace node with its child
         struct rbtree_node* child = node->left != NULL ? node->left : node->right;
@@ -204,6 +290,8 @@ void rbtree_remove(struct rbtree* tree, struct rbtree_node* node) {
             tree->root = child;
         }
 
+        augment_path(tree, parent);
+
         // case 0: node has one child
         if (child != NULL) {
             child->parent = parent;
@@ -220,6 +308,10 @@ void rbtree_remove(struct rbtree* tree, struct rbtree_node* node) {
     }
 }
 
+void rbtree_augment_update(struct rbtree* tree, struct rbtree_node* node) {
+    augment_path(tree, node);
+}
+
 static void removal_balancing(struct rbtree* tree, struct rbtree_node* sibling) {
     // rebalance tree for removal of black node
 
@@ -307,6 +399,15 @@ static struct rbtree_node* get_min_node(struct rbtree_node* node) {
     }
 }
 
+static struct rbtree_node* get_max_node(struct rbtree_node* node) {
+    while (1) {
+        if (node->right == NULL) {
+            return node;
+        }
+        node = node->right;
+    }
+}
+
 static void rotate_left(struct rbtree* tree, struct rbtree_node* node) {
     struct rbtree_node* parent = node->parent;
     struct rbtree_node* right = node->right;
@@ -330,6 +431,10 @@ static void rotate_left(struct rbtree* tree, struct rbtree_node* node) {
     } else {
         tree->root = right;
     }
+
+    // node is now right's child and right covers the subtree node did
+    augment_node(tree, node);
+    augment_node(tree, right);
 }
 
 static void rotate_right(struct rbtree* tree, struct rbtree_node* node) {
@@ -355,4 +460,7 @@ static void rotate_right(struct rbtree* tree, struct rbtree_node* node) {
     } else {
         tree->root = left;
     }
+
+    augment_node(tree, node);
+    augment_node(tree, left);
 }
@@ -1,3 +1,5 @@
+#include <freec/stdlib.h>
+#include <freec/string.h>
 #include <freec/assert.h>
 
 #include "collections/ringbuffer.h"
@@ -8,6 +10,7 @@ void ringbuffer_init(struct ringbuffer* rb, void* buffer, size_t maxlen) {
     rb->tail = 0;
     rb->count = 0;
     rb->maxlen = maxlen;
+    rb->mask = (maxlen & (maxlen - 1)) == 0 ? maxlen - 1 : 0;
 }
 
 bool ringbuffer_is_full(struct ringbuffer* rb) {
@@ -18,14 +21,16 @@ bool ringbuffer_is_empty(struct ringbuffer* rb) {
     return rb->count == 0;
 }
 
+// index < 2 * maxlen, which compiles to a compare and a conditional move
+static size_t ringbuffer_wrap(const struct ringbuffer* rb, size_t index) {
+    return index >= rb->maxlen ? index - rb->maxlen : index;
+}
+
 size_t ringbuffer_push_index(struct ringbuffer* rb) {
     assert(rb->count < rb->maxlen, "ringbuffer is full");
 
     size_t last = rb->tail;
-    rb->tail += 1;
-    if (rb->tail == rb->maxlen) {
-        rb->tail = 0;
-    }
+    rb->tail = ringbuffer_wrap(rb, rb->tail + 1);
     rb->count += 1;
     return last;
 }
@@ -34,10 +39,59 @@ size_t ringbuffer_pop_index(struct ringbuffer* rb) {
     assert(rb->count > 0, "ringbuffer is empty");
 
     size_t first = rb->head;
-    rb->head += 1;
-    if (rb->head == rb->maxlen) {
-        rb->head = 0;
-    }
+    rb->head = ringbuffer_wrap(rb, rb->head + 1);
     rb->count -= 1;
     return first;
 }
+
+size_t ringbuffer_peek(struct ringbuffer* rb, size_t* index) {
+    *index = rb->head;
+    return MIN(rb->count, rb->maxlen - rb->head);
+}
+
+void ringbuffer_consume(struct ringbuffer* rb, size_t n) {
+    assert(n <= rb->count, "ringbuffer is empty");
+    rb->head = ringbuffer_wrap(rb, rb->head + n);
+    rb->count -= n;
+}
+
+size_t ringbuffer_reserve(struct ringbuffer* rb, size_t* index) {
+    *index = rb->tail;
+    return MIN(rb->maxlen - rb->count, rb->maxlen - rb->tail);
+}
+
+void ringbuffer_commit(struct ringbuffer* rb, size_t n) {
+    assert(n <= rb->maxlen - rb->count, "ringbuffer is full");
+    rb->tail = ringbuffer_wrap(rb, rb->tail + n);
+    rb->count += n;
+}
+
+// the index after n <= maxlen more elements, with the wrap chosen once per bulk copy
+static size_t ringbuffer_advance_n(const struct ringbuffer* rb, size_t index, size_t n) {
+    return rb->mask ? (index + n) & rb->mask : ringbuffer_wrap(rb, index + n);
+}
+
+// at most two spans: up to the end of the buffer, then from its start
+size_t ringbuffer_push_n(struct ringbuffer* rb, const void* src, size_t elem_size, size_t n) {
+    const char* in = src;
+    const size_t len = MIN(n, rb->maxlen - rb->count);
+    const size_t first = MIN(len, rb->maxlen - rb->tail);
+    memcpy(rb->buffer + rb->tail * elem_size, in, first * elem_size);
+    memcpy(rb->buffer, in + first * elem_size, (len - first) * elem_size);
+
+    rb->tail = ringbuffer_advance_n(rb, rb->tail, len);
+    rb->count += len;
+    return len;
+}
+
+size_t ringbuffer_pop_n(struct ringbuffer* rb, void* dest, size_t elem_size, size_t n) {
+    char* out = dest;
+    const size_t len = MIN(n, rb->count);
+    const size_t first = MIN(len, rb->maxlen - rb->head);
+    memcpy(out, rb->buffer + rb->head * elem_size, first * elem_size);
+    memcpy(out + first * elem_size, rb->buffer, (len - first) * elem_size);
+
+    rb->head = ringbuffer_advance_n(rb, rb->head, len);
+    rb->count -= len;
+    return len;
+}
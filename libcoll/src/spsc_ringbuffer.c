@@ -0,0 +1,84 @@
+#include <freec/stdlib.h>
+#include <freec/string.h>
+#include <freec/assert.h>
+
+#include "collections/spsc_ringbuffer.h"
+
+// the producer publishes a slot by a release store of tail after writing it, and the consumer
+// hands it back by a release store of head after reading it
+static size_t load_acquire(const size_t* index) {
+    return __atomic_load_n(index, __ATOMIC_ACQUIRE);
+}
+
+static void store_release(size_t* index, size_t value) {
+    __atomic_store_n(index, value, __ATOMIC_RELEASE);
+}
+
+void spsc_ringbuffer_init(struct spsc_ringbuffer* rb, void* buffer, size_t elem_size, size_t maxlen) {
+    assert(maxlen > 0 && (maxlen & (maxlen - 1)) == 0, "spsc ringbuffer length must be a power of two");
+    rb->buffer = buffer;
+    rb->elem_size = elem_size;
+    rb->mask = maxlen - 1;
+    rb->head = 0;
+    rb->tail_cache = 0;
+    rb->tail = 0;
+    rb->head_cache = 0;
+}
+
+size_t spsc_ringbuffer_maxlen(const struct spsc_ringbuffer* rb) {
+    return rb->mask + 1;
+}
+
+size_t spsc_ringbuffer_count(const struct spsc_ringbuffer* rb) {
+    const size_t head = load_acquire(&rb->head);
+    return load_acquire(&rb->tail) - head;
+}
+
+bool spsc_ringbuffer_is_empty(const struct spsc_ringbuffer* rb) {
+    return spsc_ringbuffer_count(rb) == 0;
+}
+
+bool spsc_ringbuffer_push(struct spsc_ringbuffer* rb, const void* elem) {
+    const size_t tail = rb->tail;
+    if (tail - rb->head_cache > rb->mask) {
+        rb->head_cache = load_acquire(&rb->head);
+        if (tail - rb->head_cache > rb->mask) {
+            return false;
+        }
+    }
+    memcpy(rb->buffer + (tail & rb->mask) * rb->elem_size, elem, rb->elem_size);
+    store_release(&rb->tail, tail + 1);
+    return true;
+}
+
+bool spsc_ringbuffer_pop(struct spsc_ringbuffer* rb, void* elem) {
+    const size_t head = rb->head;
+    if (head == rb->tail_cache) {
+        rb->tail_cache = load_acquire(&rb->tail);
+        if (head == rb->tail_cache) {
+            return false;
+        }
+    }
+    memcpy(elem, rb->buffer + (head & rb->mask) * rb->elem_size, rb->elem_size);
+    store_release(&rb->head, head + 1);
+    return true;
+}
+
+size_t spsc_ringbuffer_pop_n(struct spsc_ringbuffer* rb, void* elems, size_t n) {
+    const size_t head = rb->head;
+    if (rb->tail_cache - head < n) {
+        rb->tail_cache = load_acquire(&rb->tail);
+    }
+    n = MIN(n, rb->tail_cache - head);
+    if (n == 0) {
+        return 0;
+    }
+
+    // at most two spans: up to the end of the buffer, then from its start
+    const size_t start = head & rb->mask;
+    const size_t first = MIN(n, rb->mask + 1 - start);
+    memcpy(elems, rb->buffer + start * rb->elem_size, first * rb->elem_size);
+    memcpy((char*)elems + first * rb->elem_size, rb->buffer, (n - first) * rb->elem_size);
+    store_release(&rb->head, head + n);
+    return n;
+}
@@ -0,0 +1,138 @@
+#include <gtest/gtest.h>
+
+extern "C" {
+#include "collections/mpmc_queue.h"
+}
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+struct mpmc_testqueue {
+    std::vector<size_t> slots;
+    mpmc_queue q;
+    mpmc_testqueue(size_t elem_size, size_t maxlen)
+        : slots(maxlen * MPMC_QUEUE_SLOT_SIZE(elem_size) / sizeof(size_t)) {
+        mpmc_queue_init(&q, slots.data(), elem_size, maxlen);
+    }
+    mpmc_queue* get() {
+        return &q;
+    }
+};
+
+TEST(mpmc_queue_test, initializes_correctly) {
+    mpmc_testqueue q(sizeof(uint64_t), 8);
+    EXPECT_EQ(mpmc_queue_maxlen(q.get()), 8);
+    EXPECT_EQ(q.get()->slot_size, 16);
+    uint64_t val;
+    EXPECT_FALSE(mpmc_queue_pop(q.get(), &val));
+}
+
+TEST(mpmc_queue_test, counters_live_on_separate_cache_lines) {
+    EXPECT_GE(offsetof(mpmc_queue, dequeue_pos) - offsetof(mpmc_queue, enqueue_pos), MPMC_QUEUE_CACHELINE);
+}
+
+TEST(mpmc_queue_test, slot_size_keeps_sequence_aligned) {
+    EXPECT_EQ(MPMC_QUEUE_SLOT_SIZE(1), 16);
+    EXPECT_EQ(MPMC_QUEUE_SLOT_SIZE(8), 16);
+    EXPECT_EQ(MPMC_QUEUE_SLOT_SIZE(9), 24);
+}
+
+TEST(mpmc_queue_test, fills_and_drains_in_order) {
+    mpmc_testqueue q(sizeof(uint16_t), 4);
+    for (uint16_t cycle = 0; cycle < 5; cycle++) {
+        for (uint16_t i = 0; i < 4; i++) {
+            const uint16_t val = cycle * 10 + i;
+            EXPECT_TRUE(mpmc_queue_push(q.get(), &val));
+        }
+        const uint16_t extra = 99;
+        EXPECT_FALSE(mpmc_queue_push(q.get(), &extra));
+
+        for (uint16_t i = 0; i < 4; i++) {
+            uint16_t val;
+            EXPECT_TRUE(mpmc_queue_pop(q.get(), &val));
+            EXPECT_EQ(val, cycle * 10 + i);
+        }
+        uint16_t val;
+        EXPECT_FALSE(mpmc_queue_pop(q.get(), &val));
+    }
+}
+
+TEST(mpmc_queue_test, non_power_of_two_death) {
+    std::vector<size_t> slots(6 * 2);
+    mpmc_queue q;
+    EXPECT_DEATH(mpmc_queue_init(&q, slots.data(), sizeof(uint64_t), 6), "power of two");
+}
+
+// every producer pushes an increasing sequence tagged with its id, so each consumer must see
+// every producer's items in order, and all consumers together must see every item exactly once
+static void mpmc_stress(size_t producers, size_t consumers, size_t maxlen, uint64_t per_producer) {
+    mpmc_testqueue q(sizeof(uint64_t), maxlen);
+
+    std::atomic<uint64_t> sum = 0;
+    std::atomic<uint64_t> received = 0;
+    std::atomic<bool> out_of_order = false;
+    const uint64_t total = per_producer * producers;
+
+    const auto begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t p = 0; p < producers; p++) {
+        threads.emplace_back([&q, p, per_producer] {
+            for (uint64_t i = 0; i < per_producer; i++) {
+                const uint64_t val = (uint64_t)p << 32 | i;
+                while (!mpmc_queue_push(q.get(), &val)) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (size_t c = 0; c < consumers; c++) {
+        threads.emplace_back([&, producers] {
+            std::vector<int64_t> last(producers, -1);
+            uint64_t local_sum = 0;
+            while (received.load() < total) {
+                uint64_t val;
+                if (!mpmc_queue_pop(q.get(), &val)) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                const size_t p = val >> 32;
+                const int64_t i = val & 0xffffffff;
+                if (p >= producers || i <= last[p]) {
+                    out_of_order = true;
+                }
+                last[p] = i;
+                local_sum += i;
+                received++;
+            }
+            sum += local_sum;
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    EXPECT_FALSE(out_of_order);
+    EXPECT_EQ(received.load(), total);
+    EXPECT_EQ(sum.load(), producers * (per_producer * (per_producer - 1) / 2));
+    uint64_t val;
+    EXPECT_FALSE(mpmc_queue_pop(q.get(), &val));
+    std::cout << producers << "p/" << consumers << "c push+pop: "
+        << std::chrono::duration<double, std::nano>(end - begin).count() / total << " ns/op\n";
+}
+
+TEST(mpmc_queue_test, stress_single_producer_single_consumer) {
+    mpmc_stress(1, 1, 1024, 1000000);
+}
+
+TEST(mpmc_queue_test, stress_many_producers_many_consumers) {
+    mpmc_stress(4, 4, 1024, 1000000);
+}
+
+TEST(mpmc_queue_test, stress_small_queue) {
+    mpmc_stress(3, 2, 2, 100000);
+}
@@ -0,0 +1,238 @@
+#include <gtest/gtest.h>
+
+extern "C" {
+#define restrict
+#include "collections/rbtree.h"
+};
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <random>
+#include <set>
+#include <vector>
+
+enum { RED, BLK };
+
+// [begin, end) intervals keyed by begin, augmented with the max end of each subtree
+struct interval {
+    rbtree_node node;
+    uintptr_t begin;
+    uintptr_t end;
+    uintptr_t max_end;
+};
+
+static interval* interval_of(const rbtree_node* node) {
+    return (interval*)((char*)node - offsetof(interval, node));
+}
+
+static int interval_compare(const rbtree_node* lhs, const rbtree_node* rhs) {
+    const uintptr_t a = interval_of(lhs)->begin, b = interval_of(rhs)->begin;
+    return (a > b) - (a < b);
+}
+
+static int interval_compare_key(const void* key, const rbtree_node* node) {
+    const uintptr_t a = *(const uintptr_t*)key, b = interval_of(node)->begin;
+    return (a > b) - (a < b);
+}
+
+static size_t g_augment_calls;
+
+static void interval_augment(rbtree_node* node) {
+    interval* iv = interval_of(node);
+    iv->max_end = iv->end;
+    if (node->left) {
+        iv->max_end = std::max(iv->max_end, interval_of(node->left)->max_end);
+    }
+    if (node->right) {
+        iv->max_end = std::max(iv->max_end, interval_of(node->right)->max_end);
+    }
+    g_augment_calls++;
+}
+
+static const rbtree_ops g_interval_ops = { interval_compare, interval_augment };
+
+// the leftmost interval overlapping [begin, end), skipping subtrees whose max end is too small
+static interval* interval_first_overlap(rbtree* tree, uintptr_t begin, uintptr_t end) {
+    rbtree_node* node = tree->root;
+    interval* found = nullptr;
+    while (node) {
+        if (node->left && interval_of(node->left)->max_end > begin) {
+            // an overlap on the left would start earlier than any at node or on the right
+            if (interval_of(node)->begin < end && interval_of(node)->end > begin) {
+                found = interval_of(node);
+            }
+            node = node->left;
+            continue;
+        }
+        if (interval_of(node)->begin < end && interval_of(node)->end > begin) {
+            return interval_of(node);
+        }
+        if (interval_of(node)->begin >= end) {
+            break;
+        }
+        node = node->right;
+    }
+    return found;
+}
+
+// returns the black height, checks colors, parent links, order and max_end
+static int check_subtree(const rbtree_node* node, const rbtree_node* parent) {
+    if (!node) {
+        return 1;
+    }
+    EXPECT_EQ(node->parent, parent);
+    if (node->color == RED) {
+        EXPECT_TRUE(!node->left || node->left->color == BLK);
+        EXPECT_TRUE(!node->right || node->right->color == BLK);
+    }
+    uintptr_t max_end = interval_of(node)->end;
+    if (node->left) {
+        EXPECT_LT(interval_of(node->left)->begin, interval_of(node)->begin);
+        max_end = std::max(max_end, interval_of(node->left)->max_end);
+    }
+    if (node->right) {
+        EXPECT_GT(interval_of(node->right)->begin, interval_of(node)->begin);
+        max_end = std::max(max_end, interval_of(node->right)->max_end);
+    }
+    EXPECT_EQ(interval_of(node)->max_end, max_end);
+
+    const int left = check_subtree(node->left, node);
+    const int right = check_subtree(node->right, node);
+    EXPECT_EQ(left, right);
+    return left + (node->color == BLK);
+}
+
+static void check_tree(const rbtree* tree) {
+    if (tree->root) {
+        EXPECT_EQ(tree->root->color, BLK);
+    }
+    check_subtree(tree->root, nullptr);
+}
+
+TEST(rbtree_augment_test, orders_by_comparator) {
+    // keys on both sides of the sign bit, which an int or intptr_t key would misorder
+    const uintptr_t begins[] = { 0xffff800000001000, 0x1000, 0xffff800000000000, 0x7fffffffffff0000 };
+    interval ivs[4];
+    rbtree tree;
+    rbtree_init_ops(&tree, &g_interval_ops);
+    for (int i = 0; i < 4; i++) {
+        ivs[i].begin = begins[i];
+        ivs[i].end = begins[i] + 0x1000;
+        ASSERT_TRUE(rbtree_insert(&tree, &ivs[i].node));
+    }
+    interval dup;
+    dup.begin = 0x1000;
+    dup.end = 0x3000;
+    ASSERT_FALSE(rbtree_insert(&tree, &dup.node));
+
+    std::vector<uintptr_t> order;
+    for (rbtree_node* node = rbtree_first(&tree); node; node = rbtree_next(node)) {
+        order.push_back(interval_of(node)->begin);
+    }
+    ASSERT_TRUE(std::is_sorted(order.begin(), order.end()));
+    ASSERT_EQ(order.size(), 4);
+
+    std::vector<uintptr_t> reversed;
+    for (rbtree_node* node = rbtree_last(&tree); node; node = rbtree_prev(node)) {
+        reversed.push_back(interval_of(node)->begin);
+    }
+    std::reverse(reversed.begin(), reversed.end());
+    ASSERT_EQ(order, reversed);
+
+    ASSERT_EQ(interval_of(tree.root)->max_end, 0xffff800000002000);
+    check_tree(&tree);
+}
+
+TEST(rbtree_augment_test, find_by_key) {
+    interval ivs[3];
+    rbtree tree;
+    rbtree_init_ops(&tree, &g_interval_ops);
+    for (int i = 0; i < 3; i++) {
+        ivs[i].begin = (uintptr_t)(i + 1) * 0x10000;
+        ivs[i].end = ivs[i].begin + 0x100;
+        rbtree_insert(&tree, &ivs[i].node);
+    }
+
+    uintptr_t key = 0x20000;
+    rbtree_find_result r = rbtree_find_by(&tree, &key, interval_compare_key);
+    ASSERT_EQ(r.lower, &ivs[1].node);
+    ASSERT_EQ(r.upper, &ivs[1].node);
+    ASSERT_EQ(r.to_insert, nullptr);
+
+    key = 0x28000;
+    r = rbtree_find_by(&tree, &key, interval_compare_key);
+    ASSERT_EQ(r.lower, &ivs[1].node);
+    ASSERT_EQ(r.upper, &ivs[2].node);
+    ASSERT_NE(r.to_insert, nullptr);
+
+    key = 0;
+    r = rbtree_find_by(&tree, &key, interval_compare_key);
+    ASSERT_EQ(r.lower, nullptr);
+    ASSERT_EQ(r.upper, &ivs[0].node);
+}
+
+TEST(rbtree_augment_test, random_interval_tree) {
+    const size_t count = 2000;
+    std::mt19937_64 rng(42);
+    std::vector<interval> ivs(count);
+    std::vector<bool> in_tree(count, false);
+    rbtree tree;
+    rbtree_init_ops(&tree, &g_interval_ops);
+
+    std::set<uintptr_t> begins;
+    for (interval& iv : ivs) {
+        do {
+            iv.begin = rng() % 0x1000000;
+        } while (!begins.insert(iv.begin).second);
+        iv.end = iv.begin + 1 + rng() % 0x4000;
+    }
+
+    for (int op = 0; op < 20000; op++) {
+        const size_t i = rng() % count;
+        if (in_tree[i]) {
+            rbtree_remove(&tree, &ivs[i].node);
+        } else {
+            ASSERT_TRUE(rbtree_insert(&tree, &ivs[i].node));
+        }
+        in_tree[i] = !in_tree[i];
+        if (op % 500 == 0) {
+            check_tree(&tree);
+        }
+
+        // the first overlap must match a linear scan
+        const uintptr_t begin = rng() % 0x1000000;
+        const uintptr_t end = begin + 1 + rng() % 0x1000;
+        const interval* expected = nullptr;
+        for (size_t j = 0; j < count; j++) {
+            if (in_tree[j] && ivs[j].begin < end && ivs[j].end > begin
+                && (!expected || ivs[j].begin < expected->begin)) {
+                expected = &ivs[j];
+            }
+        }
+        ASSERT_EQ(interval_first_overlap(&tree, begin, end), expected);
+    }
+    check_tree(&tree);
+}
+
+TEST(rbtree_augment_test, augment_work_is_logarithmic) {
+    const size_t count = 1 << 14;
+    std::vector<interval> ivs(count);
+    rbtree tree;
+    rbtree_init_ops(&tree, &g_interval_ops);
+    for (size_t i = 0; i < count; i++) {
+        ivs[i].begin = i * 0x100;
+        ivs[i].end = ivs[i].begin + 0x80;
+    }
+
+    g_augment_calls = 0;
+    for (interval& iv : ivs) {
+        rbtree_insert(&tree, &iv.node);
+    }
+    for (size_t i = 0; i < count; i += 2) {
+        rbtree_remove(&tree, &ivs[i].node);
+    }
+    // a path is at most 2 * log2(n) long, plus two calls per rotation
+    ASSERT_LT(g_augment_calls, (count + count / 2) * 40);
+    check_tree(&tree);
+}
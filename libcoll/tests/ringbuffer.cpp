@@ -280,3 +280,100 @@ TEST(test_ringbuffer, large_buffer) {
     }
     EXPECT_TRUE(ringbuffer_is_empty(rb.get()));
 }
+
+TEST(test_ringbuffer, power_of_two_uses_mask) {
+    testbuffer rb4(4 * sizeof(int), 4);
+    EXPECT_EQ(rb4->mask, 3);
+    testbuffer rb5(5 * sizeof(int), 5);
+    EXPECT_EQ(rb5->mask, 0);
+
+    for (int cycle = 0; cycle < 5; cycle++) {
+        for (int i = 0; i < 3; i++) {
+            ringbuffer_push(rb4.get(), int, cycle * 10 + i);
+        }
+        for (int i = 0; i < 3; i++) {
+            EXPECT_EQ(ringbuffer_pop(rb4.get(), int), cycle * 10 + i);
+        }
+        EXPECT_LT(rb4->head, 4);
+        EXPECT_EQ(rb4->head, rb4->tail);
+    }
+}
+
+TEST(test_ringbuffer, push_n_and_pop_n_wrap) {
+    for (size_t maxlen : { 7, 8 }) {
+        testbuffer rb(maxlen * sizeof(int), maxlen);
+        int next_push = 0, next_pop = 0;
+        for (int round = 0; round < 20; round++) {
+            int in[5];
+            for (int& v : in) {
+                v = next_push++;
+            }
+            EXPECT_EQ(ringbuffer_push_n(rb.get(), in, sizeof(int), 5), 5);
+
+            int out[8];
+            EXPECT_EQ(ringbuffer_pop_n(rb.get(), out, sizeof(int), 8), 5);
+            for (int i = 0; i < 5; i++) {
+                EXPECT_EQ(out[i], next_pop++);
+            }
+            EXPECT_TRUE(ringbuffer_is_empty(rb.get()));
+        }
+    }
+}
+
+TEST(test_ringbuffer, push_n_stops_when_full) {
+    testbuffer rb(4 * sizeof(int), 4);
+    int in[6] = { 1, 2, 3, 4, 5, 6 };
+    EXPECT_EQ(ringbuffer_push_n(rb.get(), in, sizeof(int), 6), 4);
+    EXPECT_TRUE(ringbuffer_is_full(rb.get()));
+    EXPECT_EQ(ringbuffer_push_n(rb.get(), in, sizeof(int), 1), 0);
+
+    int out[6];
+    EXPECT_EQ(ringbuffer_pop_n(rb.get(), out, sizeof(int), 6), 4);
+    EXPECT_EQ(out[3], 4);
+    EXPECT_EQ(ringbuffer_pop_n(rb.get(), out, sizeof(int), 1), 0);
+}
+
+TEST(test_ringbuffer, reserve_commit_and_peek_consume) {
+    testbuffer rb(5 * sizeof(int), 5);
+    int* data = (int*)rb->buffer;
+
+    // move head and tail to index 3
+    for (int i = 0; i < 3; i++) {
+        ringbuffer_push(rb.get(), int, i);
+        (void)ringbuffer_pop(rb.get(), int);
+    }
+
+    size_t index;
+    size_t len = ringbuffer_reserve(rb.get(), &index);
+    EXPECT_EQ(index, 3);
+    EXPECT_EQ(len, 2);  // up to the end of the buffer
+    data[index] = 30;
+    data[index + 1] = 40;
+    ringbuffer_commit(rb.get(), 2);
+
+    len = ringbuffer_reserve(rb.get(), &index);
+    EXPECT_EQ(index, 0);
+    EXPECT_EQ(len, 3);
+    data[index] = 50;
+    ringbuffer_commit(rb.get(), 1);
+    EXPECT_EQ(rb->count, 3);
+
+    len = ringbuffer_peek(rb.get(), &index);
+    EXPECT_EQ(index, 3);
+    EXPECT_EQ(len, 2);
+    EXPECT_EQ(data[index], 30);
+    ringbuffer_consume(rb.get(), 2);
+
+    len = ringbuffer_peek(rb.get(), &index);
+    EXPECT_EQ(index, 0);
+    EXPECT_EQ(len, 1);
+    EXPECT_EQ(data[index], 50);
+    ringbuffer_consume(rb.get(), 1);
+    EXPECT_TRUE(ringbuffer_is_empty(rb.get()));
+    EXPECT_EQ(ringbuffer_peek(rb.get(), &index), 0);
+}
+
+TEST(test_ringbuffer, commit_past_free_space_death) {
+    testbuffer rb(3 * sizeof(int), 3);
+    EXPECT_DEATH(ringbuffer_commit(rb.get(), 4), "ringbuffer is full");
+}
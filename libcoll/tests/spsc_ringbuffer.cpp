@@ -0,0 +1,127 @@
+#include <gtest/gtest.h>
+
+extern "C" {
+#include "collections/spsc_ringbuffer.h"
+}
+
+#include <stdint.h>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+struct spsc_testbuffer {
+    std::vector<uint64_t> buffer;
+    spsc_ringbuffer rb;
+    explicit spsc_testbuffer(size_t maxlen) : buffer(maxlen) {
+        spsc_ringbuffer_init(&rb, buffer.data(), sizeof(uint64_t), maxlen);
+    }
+    spsc_ringbuffer* get() {
+        return &rb;
+    }
+};
+
+TEST(spsc_ringbuffer_test, initializes_correctly) {
+    spsc_testbuffer rb(8);
+    EXPECT_EQ(spsc_ringbuffer_maxlen(rb.get()), 8);
+    EXPECT_EQ(spsc_ringbuffer_count(rb.get()), 0);
+    EXPECT_TRUE(spsc_ringbuffer_is_empty(rb.get()));
+}
+
+TEST(spsc_ringbuffer_test, indices_live_on_separate_cache_lines) {
+    EXPECT_GE(offsetof(spsc_ringbuffer, tail) - offsetof(spsc_ringbuffer, head), SPSC_RINGBUFFER_CACHELINE);
+    EXPECT_EQ(offsetof(spsc_ringbuffer, head) % SPSC_RINGBUFFER_CACHELINE, 0);
+}
+
+TEST(spsc_ringbuffer_test, fills_and_drains_in_order) {
+    spsc_testbuffer rb(4);
+    for (uint64_t cycle = 0; cycle < 3; cycle++) {
+        for (uint64_t i = 0; i < 4; i++) {
+            const uint64_t val = cycle * 10 + i;
+            EXPECT_TRUE(spsc_ringbuffer_push(rb.get(), &val));
+        }
+        const uint64_t extra = 99;
+        EXPECT_FALSE(spsc_ringbuffer_push(rb.get(), &extra));
+        EXPECT_EQ(spsc_ringbuffer_count(rb.get()), 4);
+
+        for (uint64_t i = 0; i < 4; i++) {
+            uint64_t val;
+            EXPECT_TRUE(spsc_ringbuffer_pop(rb.get(), &val));
+            EXPECT_EQ(val, cycle * 10 + i);
+        }
+        uint64_t val;
+        EXPECT_FALSE(spsc_ringbuffer_pop(rb.get(), &val));
+        EXPECT_TRUE(spsc_ringbuffer_is_empty(rb.get()));
+    }
+}
+
+TEST(spsc_ringbuffer_test, wraps_around_correctly) {
+    spsc_testbuffer rb(4);
+    uint64_t next_push = 0, next_pop = 0;
+    for (int round = 0; round < 50; round++) {
+        for (int i = 0; i < 3; i++) {
+            EXPECT_TRUE(spsc_ringbuffer_push(rb.get(), &next_push));
+            next_push++;
+        }
+        for (int i = 0; i < 3; i++) {
+            uint64_t val;
+            EXPECT_TRUE(spsc_ringbuffer_pop(rb.get(), &val));
+            EXPECT_EQ(val, next_pop++);
+        }
+    }
+}
+
+TEST(spsc_ringbuffer_test, non_power_of_two_death) {
+    std::vector<uint64_t> buffer(5);
+    spsc_ringbuffer rb;
+    EXPECT_DEATH(spsc_ringbuffer_init(&rb, buffer.data(), sizeof(uint64_t), 5), "power of two");
+}
+
+// one producer and one consumer thread pass a sequence through a small queue
+TEST(spsc_ringbuffer_test, threaded_throughput) {
+    const uint64_t count = 10000000;
+    spsc_testbuffer rb(1024);
+
+    const auto begin = std::chrono::steady_clock::now();
+    std::thread producer([&rb, count] {
+        for (uint64_t i = 0; i < count; i++) {
+            while (!spsc_ringbuffer_push(rb.get(), &i)) {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    uint64_t mismatches = 0;
+    for (uint64_t expected = 0; expected < count; expected++) {
+        uint64_t val;
+        while (!spsc_ringbuffer_pop(rb.get(), &val)) {
+            std::this_thread::yield();
+        }
+        mismatches += val != expected;
+    }
+    producer.join();
+    const auto end = std::chrono::steady_clock::now();
+
+    EXPECT_EQ(mismatches, 0);
+    EXPECT_TRUE(spsc_ringbuffer_is_empty(rb.get()));
+    std::cout << "spsc push+pop: "
+        << std::chrono::duration<double, std::nano>(end - begin).count() / count << " ns/op\n";
+}
+
+TEST(spsc_ringbuffer_test, pop_n_across_the_wrap) {
+    spsc_testbuffer rb(8);
+    uint64_t next_push = 0, next_pop = 0;
+    for (int round = 0; round < 20; round++) {
+        for (int i = 0; i < 5; i++) {
+            EXPECT_TRUE(spsc_ringbuffer_push(rb.get(), &next_push));
+            next_push++;
+        }
+        uint64_t out[8];
+        EXPECT_EQ(spsc_ringbuffer_pop_n(rb.get(), out, 3), 3);
+        EXPECT_EQ(spsc_ringbuffer_pop_n(rb.get(), out + 3, 8), 2);
+        EXPECT_EQ(spsc_ringbuffer_pop_n(rb.get(), out, 8), 0);
+        for (int i = 0; i < 5; i++) {
+            EXPECT_EQ(out[i], next_pop++);
+        }
+    }
+}
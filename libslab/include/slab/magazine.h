@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "slab/slab.h"
+
+#define SLAB_MAGAZINE_ROUNDS 15
+
+struct slab_magazine {
+    struct slab_magazine* next;
+    size_t rounds;
+    void* objects[SLAB_MAGAZINE_ROUNDS];
+};
+
+struct slab_lock {
+    void* ctx;
+    void (*acquire)(void* ctx);
+    void (*release)(void* ctx);
+};
+
+// owned by one cpu, which must not be preempted by another user of the same cpu slot
+struct slab_cpu_cache {
+    struct slab_magazine* loaded;
+    struct slab_magazine* previous;
+    size_t hits;
+    size_t misses;
+};
+
+// the depot lock guards the backing slab, the magazine slab and both magazine lists
+struct slab_cache {
+    struct slab_allocator* slab;
+    struct slab_allocator magazines;
+    struct slab_lock lock;
+
+    struct slab_magazine* full;
+    struct slab_magazine* empty;
+    size_t full_count;
+    size_t empty_count;
+
+    struct slab_cpu_cache* cpus;
+    size_t cpu_count;
+};
+
+void slab_cache_init(struct slab_cache* cache, struct slab_allocator* slab,
+    struct slab_cpu_cache* cpus, size_t cpu_count, const struct slab_lock* lock);
+void* slab_cache_alloc(struct slab_cache* cache, size_t cpu);
+void slab_cache_dealloc(struct slab_cache* cache, size_t cpu, void* ptr);
+// returns the objects held by a cpu to the backing slab, must run on that cpu
+void slab_cache_flush(struct slab_cache* cache, size_t cpu);
+// returns the objects held by the depot to the backing slab and frees all spare magazines
+void slab_cache_reap(struct slab_cache* cache);
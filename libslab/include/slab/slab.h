@@ -2,30 +2,86 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 #include <collections/linkedlist.h>
 
 #define SLAB_PAGE 4096
+#define SLAB_MAX_ORDER 3
+#define SLAB_WASTE_PERCENT 12
 
+// a slab page of order k is SLAB_PAGE << k bytes and must be aligned to its size
 struct slab_page_allocator {
     void* ctx;
-    void* (*alloc)(void* ctx);
-    void (*dealloc)(void* ctx, void* page);
+    void* (*alloc)(void* ctx, size_t order);
+    void (*dealloc)(void* ctx, void* page, size_t order);
 };
 
 struct slab_allocator {
     struct slab_page_allocator page_allocator;
     struct linkedlist partial_list;
+    struct linkedlist empty_list;
+    struct linkedlist full_list;
+    size_t empty_count;
+    size_t empty_max;
     uint16_t object_size;
     uint16_t object_align;
     uint16_t payload_offset;
     uint16_t slot_size;
+    uint16_t color_step;
+    uint16_t color_count;
+    uint16_t color_next;
+    uint8_t order;
+    bool coloring;
+    bool debug;
+    void (*ctor)(void* obj, void* ctx);
+    void (*dtor)(void* obj, void* ctx);
+    void* object_ctx;
 };
 
+struct slab_stats {
+    size_t object_size;
+    size_t slot_size;
+    size_t page_size;
+    size_t objects;         // allocated
+    size_t capacity;        // slots of all pages
+    size_t pages;
+    size_t partial_pages;
+    size_t full_pages;
+    size_t empty_pages;
+    size_t waste;           // bytes of all pages not usable by objects: headers, redzones, padding, leftover
+};
+
+// owning slab of an object allocated from a slab of the given order, read from the first word of its page,
+// so pages that do not belong to a slab can be told apart by starting them with NULL
+struct slab_allocator* slab_of(const void* ptr, size_t order);
+
 size_t slab_page_offset(size_t align);
 size_t slab_slot_header_size(void);
 size_t slab_redzone_size(void);
 
+// checked layout: slots have a header and redzones, and free objects are poisoned
 void slab_init(struct slab_allocator* slab, size_t size, size_t align, const struct slab_page_allocator* pa);
+// lean layout: slots are bare objects which hold the free list link while free, nothing is checked
+void slab_init_release(struct slab_allocator* slab, size_t size, size_t align, const struct slab_page_allocator* pa);
 void* slab_alloc(struct slab_allocator* slab);
 void slab_dealloc(struct slab_allocator* slab, void* ptr);
+// allocates up to n objects into out and returns the count, taking runs from one page at a time
+size_t slab_alloc_batch(struct slab_allocator* slab, size_t n, void** out);
+// frees n objects, ptrs may be sorted by address so that each page is updated once
+void slab_free_batch(struct slab_allocator* slab, size_t n, void** ptrs);
+
+// the order is chosen at init to keep waste under SLAB_WASTE_PERCENT, this overrides it before first use
+void slab_set_order(struct slab_allocator* slab, size_t order);
+// objects are constructed when their page is populated and destructed when it is released.
+// they are returned by slab_alloc in the state slab_dealloc got them, so callers free them in constructed state
+// this recomputes the layout and order, so it comes before slab_set_order
+void slab_set_ctor(struct slab_allocator* slab, void (*ctor)(void* obj, void* ctx),
+    void (*dtor)(void* obj, void* ctx), void* ctx);
+// coloring, on by default, shifts the first object of each new page by a cache line within the leftover bytes
+void slab_set_coloring(struct slab_allocator* slab, bool enabled);
+void slab_get_stats(struct slab_allocator* slab, struct slab_stats* stats);
+// number of empty pages kept for reuse instead of being returned to the page allocator, 0 by default
+void slab_set_empty_max(struct slab_allocator* slab, size_t empty_max);
+// shrink callback for memory pressure: returns up to max_pages cached empty pages, and the number returned
+size_t slab_shrink(struct slab_allocator* slab, size_t max_pages);
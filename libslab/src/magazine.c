@@ -0,0 +1,176 @@
+#include "slab/magazine.h"
+#include <stdalign.h>
+#include <stdbool.h>
+#include <freec/assert.h>
+
+static void depot_lock(struct slab_cache* cache) {
+    cache->lock.acquire(cache->lock.ctx);
+}
+
+static void depot_unlock(struct slab_cache* cache) {
+    cache->lock.release(cache->lock.ctx);
+}
+
+static size_t magazine_rounds(const struct slab_magazine* mag) {
+    return mag ? mag->rounds : 0;
+}
+
+static bool magazine_is_full(const struct slab_magazine* mag) {
+    return mag && mag->rounds == SLAB_MAGAZINE_ROUNDS;
+}
+
+static void magazine_push(struct slab_magazine** list, size_t* count, struct slab_magazine* mag) {
+    mag->next = *list;
+    *list = mag;
+    (*count)++;
+}
+
+static struct slab_magazine* magazine_pop(struct slab_magazine** list, size_t* count) {
+    struct slab_magazine* mag = *list;
+    if (mag) {
+        *list = mag->next;
+        (*count)--;
+    }
+    return mag;
+}
+
+// requires the depot lock
+static void magazine_empty(struct slab_cache* cache, struct slab_magazine* mag) {
+    while (mag->rounds > 0) {
+        slab_dealloc(cache->slab, mag->objects[--mag->rounds]);
+    }
+}
+
+// requires the depot lock
+static void magazine_destroy(struct slab_cache* cache, struct slab_magazine* mag) {
+    magazine_empty(cache, mag);
+    slab_dealloc(&cache->magazines, mag);
+}
+
+void slab_cache_init(struct slab_cache* cache, struct slab_allocator* slab,
+    struct slab_cpu_cache* cpus, size_t cpu_count, const struct slab_lock* lock
+) {
+    assert(cpu_count > 0);
+    cache->slab = slab;
+    if (slab->debug) {
+        slab_init(&cache->magazines, sizeof(struct slab_magazine), alignof(struct slab_magazine),
+            &slab->page_allocator);
+    } else {
+        slab_init_release(&cache->magazines, sizeof(struct slab_magazine), alignof(struct slab_magazine),
+            &slab->page_allocator);
+    }
+    cache->lock = *lock;
+
+    cache->full = NULL;
+    cache->empty = NULL;
+    cache->full_count = 0;
+    cache->empty_count = 0;
+
+    cache->cpus = cpus;
+    cache->cpu_count = cpu_count;
+    for (size_t i = 0; i < cpu_count; i++) {
+        cpus[i] = (struct slab_cpu_cache){ 0 };
+    }
+}
+
+void* slab_cache_alloc(struct slab_cache* cache, size_t cpu) {
+    assert(cpu < cache->cpu_count);
+    struct slab_cpu_cache* cc = &cache->cpus[cpu];
+
+    while (1) {
+        if (magazine_rounds(cc->loaded) > 0) {
+            cc->hits++;
+            return cc->loaded->objects[--cc->loaded->rounds];
+        }
+
+        if (magazine_rounds(cc->previous) > 0) {
+            struct slab_magazine* tmp = cc->loaded;
+            cc->loaded = cc->previous;
+            cc->previous = tmp;
+            continue;
+        }
+
+        // both magazines are empty: trade one for a full magazine from the depot
+        depot_lock(cache);
+        struct slab_magazine* full = magazine_pop(&cache->full, &cache->full_count);
+        if (full) {
+            if (cc->previous) {
+                magazine_push(&cache->empty, &cache->empty_count, cc->previous);
+            }
+            cc->previous = cc->loaded;
+            cc->loaded = full;
+            depot_unlock(cache);
+            continue;
+        }
+
+        cc->misses++;
+        void* ptr = slab_alloc(cache->slab);
+        depot_unlock(cache);
+        return ptr;
+    }
+}
+
+void slab_cache_dealloc(struct slab_cache* cache, size_t cpu, void* ptr) {
+    assert(cpu < cache->cpu_count);
+    struct slab_cpu_cache* cc = &cache->cpus[cpu];
+
+    while (1) {
+        if (cc->loaded && !magazine_is_full(cc->loaded)) {
+            cc->loaded->objects[cc->loaded->rounds++] = ptr;
+            return;
+        }
+
+        if (cc->previous && cc->previous->rounds == 0) {
+            struct slab_magazine* tmp = cc->loaded;
+            cc->loaded = cc->previous;
+            cc->previous = tmp;
+            continue;
+        }
+
+        // loaded is full or missing: hand previous to the depot and load an empty magazine
+        depot_lock(cache);
+        struct slab_magazine* empty = magazine_pop(&cache->empty, &cache->empty_count);
+        if (!empty) {
+            empty = slab_alloc(&cache->magazines);
+            if (!empty) {
+                slab_dealloc(cache->slab, ptr);
+                depot_unlock(cache);
+                return;
+            }
+            empty->rounds = 0;
+        }
+        if (cc->previous) {
+            magazine_push(&cache->full, &cache->full_count, cc->previous);
+        }
+        cc->previous = cc->loaded;
+        cc->loaded = empty;
+        depot_unlock(cache);
+    }
+}
+
+void slab_cache_flush(struct slab_cache* cache, size_t cpu) {
+    assert(cpu < cache->cpu_count);
+    struct slab_cpu_cache* cc = &cache->cpus[cpu];
+
+    depot_lock(cache);
+    if (cc->loaded) {
+        magazine_destroy(cache, cc->loaded);
+        cc->loaded = NULL;
+    }
+    if (cc->previous) {
+        magazine_destroy(cache, cc->previous);
+        cc->previous = NULL;
+    }
+    depot_unlock(cache);
+}
+
+void slab_cache_reap(struct slab_cache* cache) {
+    depot_lock(cache);
+    while (cache->full) {
+        magazine_destroy(cache, magazine_pop(&cache->full, &cache->full_count));
+    }
+    while (cache->empty) {
+        magazine_destroy(cache, magazine_pop(&cache->empty, &cache->empty_count));
+    }
+    depot_unlock(cache);
+}
@@ -6,21 +6,28 @@
 #include <freec/assert.h>
 
 #define REDZONE_SIZE 16
+#define COLOR_ALIGN 64
+#define SLAB_BATCH_MIN_RUN 4
 
 #define EMPTY_MAGIC 0x3a49
 #define OBJECT_MAGIC 0x6b5c
 #define REDZONE_FILL 0xe3
 #define UNUSED_FILL 0xf2
 
+// header of a slab page, which spans SLAB_PAGE << order bytes and is aligned to its size.
+// owner comes first, see slab_of
 struct page {
+    struct slab_allocator* owner;
     struct linkedlist_link link;
     uint16_t free_index;
     uint16_t alloc_count;
 };
 
+// a release slot has only next, which is overwritten by the object while allocated,
+// or which comes before the object if the slab constructs its objects
 struct slot {
-    uint16_t magic;
     uint16_t next;
+    uint16_t magic;
 };
 
 static size_t align_ceil(size_t x, size_t align) {
@@ -38,6 +45,9 @@ static size_t slot_redzone1_offset() {
 }
 
 static size_t slot_payload_offset(struct slab_allocator* slab) {
+    if (!slab->debug) {
+        return slab->ctor ? align_ceil(sizeof(uint16_t), slab->object_align) : 0;
+    }
     return align_ceil(slot_redzone1_offset() + REDZONE_SIZE, slab->object_align);
 }
 
@@ -50,6 +60,10 @@ static size_t slot_redzone2_offset(struct slab_allocator* slab) {
 }
 
 static size_t slot_sizeof(struct slab_allocator* slab) {
+    if (!slab->debug) {
+        return align_ceil(MAX(slab->payload_offset + slab->object_size, sizeof(uint16_t)),
+            slot_alignof(slab->object_align));
+    }
     return align_ceil(slot_redzone2_offset(slab) + REDZONE_SIZE, slab->object_align);
 }
 
@@ -70,8 +84,11 @@ static char* slot_redzone2(struct slot* slot, struct slab_allocator* slab) {
 }
 
 static void slot_init(struct slot* slot, struct slab_allocator* slab) {
-    slot->magic = EMPTY_MAGIC;
     slot->next = 0;
+    if (!slab->debug) {
+        return;
+    }
+    slot->magic = EMPTY_MAGIC;
     memset(slot_redzone1(slot), REDZONE_FILL, slot_redzone1_size(slab));
     memset(slot_payload(slot, slab), UNUSED_FILL, slab->object_size);
     memset(slot_redzone2(slot, slab), REDZONE_FILL, slot_redzone2_size(slab));
@@ -90,30 +107,43 @@ static void slot_write_unused(struct slot* slot, struct slab_allocator* slab, in
     memset(slot_payload(slot, slab), b, slab->object_size);
 }
 
+// constructed objects keep their state while free, so they are neither poisoned nor zeroed
 static void slot_on_alloc(struct slot* slot, struct slab_allocator* slab) {
     assert(slot->magic == EMPTY_MAGIC && slot->next == 0, "slab is poisoned");
     assert(slot_check_redzone(slot, slab), "redzone is corrupted");
-    assert(slot_check_unused(slot, slab), "slab is poisoned");
     slot->magic = OBJECT_MAGIC;
-    slot_write_unused(slot, slab, 0);
+    if (!slab->ctor) {
+        assert(slot_check_unused(slot, slab), "slab is poisoned");
+        slot_write_unused(slot, slab, 0);
+    }
 }
 
 static void slot_on_dealloc(struct slot* slot, struct slab_allocator* slab) {
     assert(slot->magic == OBJECT_MAGIC && slot->next == 0, "try to deallocate an object that is not allocated");
     assert(slot_check_redzone(slot, slab), "redzone is corrupted");
     slot->magic = EMPTY_MAGIC;
-    slot_write_unused(slot, slab, UNUSED_FILL);
+    if (!slab->ctor) {
+        slot_write_unused(slot, slab, UNUSED_FILL);
+    }
+}
+
+static size_t page_sizeof(size_t order) {
+    return (size_t)SLAB_PAGE << order;
 }
 
-static struct page* page_from_slot(struct slot* slot) {
+static struct page* page_from_slot(struct slot* slot, size_t order) {
     const uintptr_t raw = (uintptr_t)slot;
-    return (struct page*)(raw & ~(SLAB_PAGE - 1));
+    return (struct page*)(raw & ~(page_sizeof(order) - 1));
 }
 
 static size_t page_object_offset(size_t object_align) {
     return align_ceil(sizeof(struct page), slot_alignof(object_align));
 }
 
+struct slab_allocator* slab_of(const void* ptr, size_t order) {
+    return page_from_slot((struct slot*)ptr, order)->owner;
+}
+
 size_t slab_page_offset(size_t align) {
     return page_object_offset(align);
 }
@@ -130,18 +160,58 @@ static bool object_info_is_valid(struct slab_allocator* slab) {
     return page_object_offset(slab->object_align) + slab->slot_size <= SLAB_PAGE;
 }
 
+static size_t page_slot_count(struct slab_allocator* slab, size_t order) {
+    return (page_sizeof(order) - page_object_offset(slab->object_align)) / slab->slot_size;
+}
+
+static size_t page_waste(struct slab_allocator* slab, size_t order) {
+    return page_sizeof(order) - page_slot_count(slab, order) * slab->slot_size;
+}
+
+// pages start their first object at successive multiples of color_step within the leftover bytes
+static void slab_init_colors(struct slab_allocator* slab, bool enabled) {
+    const size_t size = page_sizeof(slab->order);
+    const size_t leftover = size - page_object_offset(slab->object_align)
+        - page_slot_count(slab, slab->order) * slab->slot_size;
+    const size_t step = MAX(COLOR_ALIGN, slot_alignof(slab->object_align));
+
+    slab->coloring = enabled;
+    slab->color_step = (uint16_t)step;
+    slab->color_count = enabled ? (uint16_t)(leftover / step + 1) : 1;
+    slab->color_next = 0;
+}
+
+// the smallest order that wastes at most SLAB_WASTE_PERCENT of a page, or else the least wasteful one
+static size_t slab_choose_order(struct slab_allocator* slab) {
+    size_t best = 0;
+    for (size_t order = 0; order <= SLAB_MAX_ORDER; order++) {
+        if (page_waste(slab, order) * 100 <= page_sizeof(order) * SLAB_WASTE_PERCENT) {
+            return order;
+        }
+        if (page_waste(slab, order) * page_sizeof(best) < page_waste(slab, best) * page_sizeof(order)) {
+            best = order;
+        }
+    }
+    return best;
+}
+
 static void page_init(struct page* page, struct slab_allocator* slab) {
-    size_t offset = page_object_offset(slab->object_align);
+    size_t offset = page_object_offset(slab->object_align) + (size_t)slab->color_next * slab->color_step;
+    slab->color_next = (uint16_t)((slab->color_next + 1) % slab->color_count);
 
+    page->owner = slab;
     page->free_index = (uint16_t)offset;
     page->alloc_count = 0;
 
     while (1) {
         struct slot* const slot = (struct slot*)((char*)page + offset);
         slot_init(slot, slab);
+        if (slab->ctor) {
+            slab->ctor(slot_payload(slot, slab), slab->object_ctx);
+        }
 
         const size_t next_offset = offset + slab->slot_size;
-        if (next_offset + slab->slot_size < SLAB_PAGE) {
+        if (next_offset + slab->slot_size <= page_sizeof(slab->order)) {
             slot->next = (uint16_t)next_offset;
             offset = next_offset;
         } else {
@@ -175,11 +245,7 @@ static void page_push_front(struct page* page, struct slot* slot) {
     page->alloc_count--;
 }
 
-void slab_init(struct slab_allocator* slab, size_t size, size_t align, const struct slab_page_allocator* pa) {
-    assert(size <= UINT16_MAX && align <= UINT16_MAX, "object is too big");
-    slab->object_size = size;
-    slab->object_align = align;
-
+static void slab_compute_layout(struct slab_allocator* slab) {
     size_t payload_offset = slot_payload_offset(slab);
     assert(payload_offset <= UINT16_MAX, "object is too big");
     slab->payload_offset = payload_offset;
@@ -189,59 +255,244 @@ void slab_init(struct slab_allocator* slab, size_t size, size_t align, const str
     slab->slot_size = slot_size;
 
     assert(object_info_is_valid(slab), "object is too big");
+    slab->order = (uint8_t)slab_choose_order(slab);
+    slab_init_colors(slab, slab->coloring);
+}
+
+static void slab_init_layout(struct slab_allocator* slab, size_t size, size_t align,
+    const struct slab_page_allocator* pa, bool debug
+) {
+    assert(size <= UINT16_MAX && align <= UINT16_MAX, "object is too big");
+    slab->object_size = size;
+    slab->object_align = align;
+    slab->debug = debug;
+    slab->coloring = true;
+    slab->ctor = NULL;
+    slab->dtor = NULL;
+    slab->object_ctx = NULL;
+    slab_compute_layout(slab);
 
     linkedlist_init(&slab->partial_list);
+    linkedlist_init(&slab->empty_list);
+    linkedlist_init(&slab->full_list);
+    slab->empty_count = 0;
+    slab->empty_max = 0;
     slab->page_allocator = *pa;
 }
 
-static struct page* slab_alloc_page(struct slab_allocator* slab) {
-    struct page* page = slab->page_allocator.alloc(slab->page_allocator.ctx);
-    if (!page) {
-        return NULL;
+void slab_init(struct slab_allocator* slab, size_t size, size_t align, const struct slab_page_allocator* pa) {
+    slab_init_layout(slab, size, align, pa, true);
+}
+
+void slab_init_release(struct slab_allocator* slab, size_t size, size_t align, const struct slab_page_allocator* pa) {
+    slab_init_layout(slab, size, align, pa, false);
+}
+
+void slab_set_order(struct slab_allocator* slab, size_t order) {
+    assert(order <= SLAB_MAX_ORDER);
+    assert(linkedlist_is_empty(&slab->partial_list) && linkedlist_is_empty(&slab->full_list),
+        "slab order cannot change while objects are allocated");
+    slab_shrink(slab, slab->empty_count);
+    slab->order = (uint8_t)order;
+    slab_init_colors(slab, slab->coloring);
+}
+
+void slab_set_ctor(struct slab_allocator* slab, void (*ctor)(void* obj, void* ctx),
+    void (*dtor)(void* obj, void* ctx), void* ctx
+) {
+    assert(linkedlist_is_empty(&slab->partial_list) && linkedlist_is_empty(&slab->full_list),
+        "slab constructor cannot change while objects are allocated");
+    slab_shrink(slab, slab->empty_count);
+    slab->ctor = ctor;
+    slab->dtor = dtor;
+    slab->object_ctx = ctx;
+    slab_compute_layout(slab);
+}
+
+void slab_set_coloring(struct slab_allocator* slab, bool enabled) {
+    slab_init_colors(slab, enabled);
+}
+
+void slab_set_empty_max(struct slab_allocator* slab, size_t empty_max) {
+    slab->empty_max = empty_max;
+    slab_shrink(slab, slab->empty_count > empty_max ? slab->empty_count - empty_max : 0);
+}
+
+// every slot of an empty page is on its freelist
+static void slab_free_page(struct slab_allocator* slab, struct page* page) {
+    if (slab->dtor) {
+        for (uint16_t index = page->free_index; index != 0;) {
+            struct slot* const slot = (struct slot*)((char*)page + index);
+            index = slot->next;
+            slab->dtor(slot_payload(slot, slab), slab->object_ctx);
+        }
     }
+    slab->page_allocator.dealloc(slab->page_allocator.ctx, page, slab->order);
+}
 
-    page_init(page, slab);
-    linkedlist_init(&slab->partial_list);   // clear partial list
-    linkedlist_push_front(&slab->partial_list, &page->link);
-    return page;
+size_t slab_shrink(struct slab_allocator* slab, size_t max_pages) {
+    size_t count = 0;
+    while (count < max_pages && !linkedlist_is_empty(&slab->empty_list)) {
+        struct page* page = container_of(linkedlist_tail(&slab->empty_list), struct page, link);
+        linkedlist_remove(&page->link);
+        slab->empty_count--;
+        slab_free_page(slab, page);
+        count++;
+    }
+    return count;
 }
 
-void* slab_alloc(struct slab_allocator* slab) {
+// page states: partial pages are allocated from first, then cached empty pages, then new pages
+static struct page* slab_take_page(struct slab_allocator* slab) {
+    if (!linkedlist_is_empty(&slab->partial_list)) {
+        return container_of(linkedlist_head(&slab->partial_list), struct page, link);
+    }
+
     struct page* page;
-    if (linkedlist_is_empty(&slab->partial_list)) {
-        page = slab_alloc_page(slab);
+    if (!linkedlist_is_empty(&slab->empty_list)) {
+        page = container_of(linkedlist_head(&slab->empty_list), struct page, link);
+        linkedlist_remove(&page->link);
+        slab->empty_count--;
+    } else {
+        page = slab->page_allocator.alloc(slab->page_allocator.ctx, slab->order);
         if (!page) {
             return NULL;
         }
-    } else {
-        struct linkedlist_link* const head = linkedlist_head(&slab->partial_list);
-        page = container_of(head, struct page, link);
+        page_init(page, slab);
+    }
+
+    linkedlist_push_front(&slab->partial_list, &page->link);
+    return page;
+}
+
+void* slab_alloc(struct slab_allocator* slab) {
+    struct page* page = slab_take_page(slab);
+    if (!page) {
+        return NULL;
     }
 
     bool full;
     struct slot* slot = page_pop_front(page, &full);
     if (full) {
         linkedlist_remove(&page->link);
+        linkedlist_push_front(&slab->full_list, &page->link);
     }
 
-    slot_on_alloc(slot, slab);
+    if (slab->debug) {
+        slot_on_alloc(slot, slab);
+    }
     return slot_payload(slot, slab);
 }
 
-void slab_dealloc(struct slab_allocator* slab, void* ptr) {
-    struct slot* slot = (struct slot*)((char*)ptr - slot_payload_offset(slab));
-    slot_on_dealloc(slot, slab);
+size_t slab_alloc_batch(struct slab_allocator* slab, size_t n, void** out) {
+    size_t count = 0;
+    while (count < n) {
+        struct page* page = slab_take_page(slab);
+        if (!page) {
+            break;
+        }
 
-    struct page* page = page_from_slot(slot);
-    const bool was_full = page->free_index == 0;
-    page_push_front(page, slot);
+        // pop a run from the freelist of this page and update the page once
+        uint16_t index = page->free_index;
+        const size_t first = count;
+        while (index != 0 && count < n) {
+            struct slot* const slot = (struct slot*)((char*)page + index);
+            index = slot->next;
+            slot->next = 0;
+            if (slab->debug) {
+                slot_on_alloc(slot, slab);
+            }
+            out[count++] = slot_payload(slot, slab);
+        }
+        page->free_index = index;
+        page->alloc_count += (uint16_t)(count - first);
 
-    if (page->alloc_count == 0) {
-        if (!was_full) {
+        if (index == 0) {
             linkedlist_remove(&page->link);
+            linkedlist_push_front(&slab->full_list, &page->link);
+        }
+    }
+    return count;
+}
+
+static void slab_page_released(struct slab_allocator* slab, struct page* page, bool was_full) {
+    if (page->alloc_count == 0) {
+        linkedlist_remove(&page->link);
+        if (slab->empty_count < slab->empty_max) {
+            linkedlist_push_front(&slab->empty_list, &page->link);
+            slab->empty_count++;
+        } else {
+            slab_free_page(slab, page);
         }
-        slab->page_allocator.dealloc(slab->page_allocator.ctx, page);
     } else if (was_full) {
+        linkedlist_remove(&page->link);
         linkedlist_push_back(&slab->partial_list, &page->link);
     }
 }
+
+static struct slot* slab_slot_of(struct slab_allocator* slab, void* ptr) {
+    struct slot* slot = (struct slot*)((char*)ptr - slab->payload_offset);
+    if (slab->debug) {
+        slot_on_dealloc(slot, slab);
+    }
+    return slot;
+}
+
+void slab_dealloc(struct slab_allocator* slab, void* ptr) {
+    struct slot* slot = slab_slot_of(slab, ptr);
+    struct page* page = page_from_slot(slot, slab->order);
+    const bool was_full = page->free_index == 0;
+    page_push_front(page, slot);
+    slab_page_released(slab, page, was_full);
+}
+
+static int comp_ptr(const void* a, const void* b) {
+    const uintptr_t pa = (uintptr_t)*(void* const*)a, pb = (uintptr_t)*(void* const*)b;
+    return pa > pb ? 1 : (pa < pb ? -1 : 0);
+}
+
+void slab_free_batch(struct slab_allocator* slab, size_t n, void** ptrs) {
+    // objects usually come in runs from the same page, e.g. from slab_alloc_batch,
+    // so only sort when the runs are too short to be worth keeping
+    size_t runs = n > 0 ? 1 : 0;
+    for (size_t i = 1; i < n; i++) {
+        if (page_from_slot((struct slot*)ptrs[i], slab->order) != page_from_slot((struct slot*)ptrs[i - 1], slab->order)) {
+            runs++;
+        }
+    }
+    if (runs * SLAB_BATCH_MIN_RUN > n) {
+        sort(ptrs, n, sizeof(void*), comp_ptr);
+    }
+
+    size_t i = 0;
+    while (i < n) {
+        struct page* const page = page_from_slot((struct slot*)ptrs[i], slab->order);
+        const bool was_full = page->free_index == 0;
+        for (; i < n && page_from_slot((struct slot*)ptrs[i], slab->order) == page; i++) {
+            page_push_front(page, slab_slot_of(slab, ptrs[i]));
+        }
+        slab_page_released(slab, page, was_full);
+    }
+}
+
+static size_t page_list_stats(struct linkedlist* list, size_t* objects) {
+    size_t count = 0;
+    for (struct linkedlist_link* link = linkedlist_head(list); !linkedlist_is_nil(list, link); link = link->next) {
+        *objects += container_of(link, struct page, link)->alloc_count;
+        count++;
+    }
+    return count;
+}
+
+void slab_get_stats(struct slab_allocator* slab, struct slab_stats* stats) {
+    stats->object_size = slab->object_size;
+    stats->slot_size = slab->slot_size;
+    stats->page_size = page_sizeof(slab->order);
+    stats->objects = 0;
+    stats->partial_pages = page_list_stats(&slab->partial_list, &stats->objects);
+    stats->full_pages = page_list_stats(&slab->full_list, &stats->objects);
+    stats->empty_pages = page_list_stats(&slab->empty_list, &stats->objects);
+    stats->pages = stats->partial_pages + stats->full_pages + stats->empty_pages;
+    stats->capacity = stats->pages * page_slot_count(slab, slab->order);
+    stats->waste = stats->pages * stats->page_size - stats->capacity * slab->object_size;
+}
@@ -0,0 +1,116 @@
+#include <iostream>
+#include <gtest/gtest.h>
+
+extern "C" {
+#define restrict
+#include "slab/slab.h"
+};
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+struct bench_slab {
+    slab_page_allocator pa;
+    slab_allocator sa;
+    std::vector<void*> objects;
+
+    bench_slab(size_t size, bool coloring) {
+        pa.ctx = nullptr;
+        pa.alloc = [](void* ctx, size_t order) -> void* {
+            return aligned_alloc((size_t)SLAB_PAGE << order, (size_t)SLAB_PAGE << order);
+        };
+        pa.dealloc = [](void* ctx, void* page, size_t order) {
+            free(page);
+        };
+        slab_init_release(&sa, size, 8, &pa);
+        slab_set_order(&sa, 0);
+        slab_set_coloring(&sa, coloring);
+    }
+    ~bench_slab() {
+        for (void* ptr : objects) {
+            slab_dealloc(&sa, ptr);
+        }
+    }
+};
+
+template <typename F>
+static double measure_ns(size_t ops, F&& f) {
+    const auto begin = std::chrono::steady_clock::now();
+    f();
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - begin).count() / ops;
+}
+
+// reads the first object of every page, which all map to the same cache sets without coloring
+static void bench_first_objects(bool coloring) {
+    const size_t size = 900;
+    const size_t pages = 1024;
+    bench_slab slab(size, coloring);
+
+    const size_t per_page = (SLAB_PAGE - slab_page_offset(8)) / slab.sa.slot_size;
+    for (size_t i = 0; i < per_page * pages; i++) {
+        void* ptr = slab_alloc(&slab.sa);
+        ASSERT_TRUE(ptr);
+        slab.objects.push_back(ptr);
+    }
+
+    std::vector<volatile uint64_t*> first;
+    for (size_t i = 0; i < slab.objects.size(); i += per_page) {
+        first.push_back((volatile uint64_t*)*std::min_element(
+            slab.objects.begin() + i, slab.objects.begin() + i + per_page));
+    }
+
+    const size_t rounds = 2000;
+    uint64_t sum = 0;
+    const double ns = measure_ns(rounds * first.size(), [&] {
+        for (size_t r = 0; r < rounds; r++) {
+            for (volatile uint64_t* p : first) {
+                sum += *p;
+            }
+        }
+    });
+    std::cout << (coloring ? "colored" : "uncolored") << " colors: " << slab.sa.color_count
+        << ", pages: " << first.size() << ", read: " << ns << " ns/object (" << sum % 2 << ")\n";
+}
+
+TEST(slab_bench, first_object_walk) {
+    bench_first_objects(false);
+    bench_first_objects(true);
+}
+
+// allocates and frees objects in groups of batch, one by one and through the batch interface
+static void bench_batch(size_t batch) {
+    bench_slab slab(64, false);
+    slab_set_empty_max(&slab.sa, 64);
+    std::vector<void*> ptrs(batch);
+
+    const size_t rounds = 20000;
+    const double loop_ns = measure_ns(rounds * batch, [&] {
+        for (size_t r = 0; r < rounds; r++) {
+            for (size_t i = 0; i < batch; i++) {
+                ptrs[i] = slab_alloc(&slab.sa);
+            }
+            for (size_t i = 0; i < batch; i++) {
+                slab_dealloc(&slab.sa, ptrs[i]);
+            }
+        }
+    });
+    const double batch_ns = measure_ns(rounds * batch, [&] {
+        for (size_t r = 0; r < rounds; r++) {
+            if (slab_alloc_batch(&slab.sa, batch, ptrs.data()) != batch) {
+                abort();
+            }
+            slab_free_batch(&slab.sa, batch, ptrs.data());
+        }
+    });
+    std::cout << "batch: " << batch << ", loop: " << loop_ns << " ns/object, batch: " << batch_ns << " ns/object\n";
+    slab_set_empty_max(&slab.sa, 0);
+}
+
+TEST(slab_bench, alloc_free_batch) {
+    bench_batch(16);
+    bench_batch(256);
+}
@@ -0,0 +1,193 @@
+#include <gtest/gtest.h>
+
+extern "C" {
+#define restrict
+#include "slab/magazine.h"
+};
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <mutex>
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+
+// pages are only requested under the depot lock, so the page list needs no lock of its own
+struct magazine_test_cache {
+    slab_page_allocator pa;
+    slab_allocator sa;
+    slab_cache cache;
+    std::vector<slab_cpu_cache> cpus;
+    std::mutex mutex;
+    std::set<void*> pages;
+
+    magazine_test_cache(const magazine_test_cache&) = delete;
+    magazine_test_cache& operator =(const magazine_test_cache&) = delete;
+
+    magazine_test_cache(size_t size, size_t cpu_count, bool debug = true)
+        : cpus(cpu_count) {
+        pa.ctx = this;
+        pa.alloc = [](void* ctx, size_t order) -> void* {
+            auto self = static_cast<magazine_test_cache*>(ctx);
+            void* page = aligned_alloc((size_t)SLAB_PAGE << order, (size_t)SLAB_PAGE << order);
+            self->pages.insert(page);
+            return page;
+        };
+        pa.dealloc = [](void* ctx, void* page, size_t order) {
+            auto self = static_cast<magazine_test_cache*>(ctx);
+            self->pages.erase(page);
+            free(page);
+        };
+        if (debug) {
+            slab_init(&sa, size, 8, &pa);
+        } else {
+            slab_init_release(&sa, size, 8, &pa);
+        }
+
+        slab_lock lock;
+        lock.ctx = &mutex;
+        lock.acquire = [](void* ctx) {
+            static_cast<std::mutex*>(ctx)->lock();
+        };
+        lock.release = [](void* ctx) {
+            static_cast<std::mutex*>(ctx)->unlock();
+        };
+        slab_cache_init(&cache, &sa, cpus.data(), cpus.size(), &lock);
+    }
+    ~magazine_test_cache() {
+        for (void* page : pages) {
+            free(page);
+        }
+    }
+    void flush_all() {
+        for (size_t cpu = 0; cpu < cpus.size(); cpu++) {
+            slab_cache_flush(&cache, cpu);
+        }
+        slab_cache_reap(&cache);
+    }
+};
+
+TEST(slab_magazine_test, reuses_last_freed_object) {
+    magazine_test_cache mc(64, 1);
+    void* a = slab_cache_alloc(&mc.cache, 0);
+    ASSERT_TRUE(a);
+    slab_cache_dealloc(&mc.cache, 0, a);
+    void* b = slab_cache_alloc(&mc.cache, 0);
+    ASSERT_EQ(a, b);
+    ASSERT_EQ(mc.cpus[0].hits, 1);
+    slab_cache_dealloc(&mc.cache, 0, b);
+    mc.flush_all();
+    ASSERT_TRUE(mc.pages.empty());
+}
+
+TEST(slab_magazine_test, depot_exchanges_magazines) {
+    magazine_test_cache mc(32, 1);
+    const size_t count = SLAB_MAGAZINE_ROUNDS * 5;
+    std::vector<void*> ptrs;
+    for (size_t i = 0; i < count; i++) {
+        ptrs.push_back(slab_cache_alloc(&mc.cache, 0));
+    }
+    for (void* ptr : ptrs) {
+        slab_cache_dealloc(&mc.cache, 0, ptr);
+    }
+    ASSERT_GT(mc.cache.full_count, 0);
+
+    // everything comes back from the magazines without touching the slab
+    const size_t misses = mc.cpus[0].misses;
+    std::vector<void*> again;
+    for (size_t i = 0; i < count; i++) {
+        again.push_back(slab_cache_alloc(&mc.cache, 0));
+    }
+    ASSERT_EQ(mc.cpus[0].misses, misses);
+    std::sort(ptrs.begin(), ptrs.end());
+    std::sort(again.begin(), again.end());
+    ASSERT_EQ(ptrs, again);
+
+    for (void* ptr : again) {
+        slab_cache_dealloc(&mc.cache, 0, ptr);
+    }
+    mc.flush_all();
+    ASSERT_TRUE(mc.pages.empty());
+    ASSERT_EQ(mc.cache.full_count, 0);
+    ASSERT_EQ(mc.cache.empty_count, 0);
+}
+
+TEST(slab_magazine_test, free_on_other_cpu) {
+    magazine_test_cache mc(48, 2, false);
+    std::vector<void*> ptrs;
+    for (int i = 0; i < 500; i++) {
+        ptrs.push_back(slab_cache_alloc(&mc.cache, 0));
+    }
+    for (void* ptr : ptrs) {
+        slab_cache_dealloc(&mc.cache, 1, ptr);
+    }
+    std::set<void*> seen;
+    for (int i = 0; i < 500; i++) {
+        void* ptr = slab_cache_alloc(&mc.cache, 0);
+        ASSERT_TRUE(seen.insert(ptr).second);
+    }
+    for (void* ptr : seen) {
+        slab_cache_dealloc(&mc.cache, 0, ptr);
+    }
+    mc.flush_all();
+    ASSERT_TRUE(mc.pages.empty());
+}
+
+static void magazine_stress(bool debug) {
+    const size_t threads = 4;
+    const size_t size = 40;
+    magazine_test_cache mc(size, threads, debug);
+
+    std::vector<std::thread> workers;
+    std::vector<char> failed(threads, false);
+    for (size_t cpu = 0; cpu < threads; cpu++) {
+        workers.emplace_back([&mc, &failed, cpu] {
+            std::mt19937 rng(cpu + 1);
+            std::vector<unsigned char*> live;
+            for (int i = 0; i < 200000; i++) {
+                if (live.empty() || (live.size() < 2000 && rng() % 2 == 0)) {
+                    auto ptr = (unsigned char*)slab_cache_alloc(&mc.cache, cpu);
+                    if (!ptr) {
+                        failed[cpu] = true;
+                        return;
+                    }
+                    memset(ptr, (int)cpu + 1, size);
+                    live.push_back(ptr);
+                } else {
+                    const size_t k = rng() % live.size();
+                    unsigned char* ptr = live[k];
+                    if (std::any_of(ptr, ptr + size, [cpu](unsigned char x) { return x != cpu + 1; })) {
+                        failed[cpu] = true;
+                        return;
+                    }
+                    slab_cache_dealloc(&mc.cache, cpu, ptr);
+                    live[k] = live.back();
+                    live.pop_back();
+                }
+            }
+            for (unsigned char* ptr : live) {
+                slab_cache_dealloc(&mc.cache, cpu, ptr);
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    for (size_t cpu = 0; cpu < threads; cpu++) {
+        ASSERT_FALSE(failed[cpu]);
+    }
+
+    mc.flush_all();
+    ASSERT_TRUE(mc.pages.empty());
+}
+
+TEST(slab_magazine_test, threaded_stress) {
+    magazine_stress(true);
+}
+
+TEST(slab_magazine_test, threaded_stress_release) {
+    magazine_stress(false);
+}
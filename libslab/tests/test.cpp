@@ -15,6 +15,7 @@ extern "C" {
 #include <stdexcept>
 #include <utility>
 #include <functional>
+#include <map>
 #include <memory>
 
 template <typename T>
@@ -26,8 +27,8 @@ T swap_remove(std::vector<T>& v, size_t index) {
     return x;
 }
 
-extern "C" void* test_alloc(void* ctx);
-extern "C" void test_dealloc(void* ctx, void* ptr);
+extern "C" void* test_alloc(void* ctx, size_t order);
+extern "C" void test_dealloc(void* ctx, void* ptr, size_t order);
 
 struct test_slab {
     slab_page_allocator pa;
@@ -37,6 +38,7 @@ struct test_slab {
     bool print_logs = false;
     std::vector<std::pair<void*, int>> pages;
     std::vector<std::pair<void*, int>> deallocated;
+    std::map<void*, size_t> page_sizes;
 
     std::function<void(test_slab&)> on_after_alloc;
     std::function<void(test_slab&)> on_before_dealloc;
@@ -44,16 +46,20 @@ struct test_slab {
     test_slab(const test_slab&) = delete;
     test_slab& operator =(const test_slab&) = delete;
 
-    test_slab(size_t size, size_t align, bool logs = false)
+    test_slab(size_t size, size_t align, bool logs = false, bool debug = true)
         : print_logs(logs) {
         pa.ctx = this;
         pa.alloc = test_alloc;
         pa.dealloc = test_dealloc;
-        slab_init(&sa, size, align, &pa);
+        if (debug) {
+            slab_init(&sa, size, align, &pa);
+        } else {
+            slab_init_release(&sa, size, align, &pa);
+        }
     }
     ~test_slab() {
         for (auto [p, i] : deallocated) {
-            bool ok = std::all_of((char*)p, (char*)p + SLAB_PAGE, [](char x) {
+            bool ok = std::all_of((char*)p, (char*)p + page_sizes[p], [](char x) {
                 return (unsigned char)x == 0xdd;
             });
             if (!ok) {
@@ -73,11 +79,13 @@ struct test_slab {
     }
 };
 
-extern "C" void* test_alloc(void* ctx) {
+extern "C" void* test_alloc(void* ctx, size_t order) {
     auto self = static_cast<test_slab*>(ctx);
-    void* const page = aligned_alloc(SLAB_PAGE, SLAB_PAGE);
-    memset(page, 0xcc, SLAB_PAGE);
+    const size_t size = (size_t)SLAB_PAGE << order;
+    void* const page = aligned_alloc(size, size);
+    memset(page, 0xcc, size);
     self->pages.emplace_back(page, ++self->count);
+    self->page_sizes[page] = size;
     if (self->print_logs) {
         printf("page #%d allocated\n", self->count);
     }
@@ -87,7 +95,7 @@ extern "C" void* test_alloc(void* ctx) {
     return page;
 }
 
-extern "C" void test_dealloc(void* ctx, void* ptr) {
+extern "C" void test_dealloc(void* ctx, void* ptr, size_t order) {
     auto self = static_cast<test_slab*>(ctx);
     auto it = find_if(self->pages.begin(), self->pages.end(), [ptr](auto pr) {
         return pr.first == ptr;
@@ -96,7 +104,8 @@ extern "C" void test_dealloc(void* ctx, void* ptr) {
     if (self->on_before_dealloc) {
         self->on_before_dealloc(*self);
     }
-    memset(it->first, 0xdd, SLAB_PAGE);
+    ASSERT_EQ(self->page_sizes[ptr], (size_t)SLAB_PAGE << order);
+    memset(it->first, 0xdd, self->page_sizes[ptr]);
     self->deallocated.push_back(*it);
     if (self->print_logs) {
         printf("page #%d deallocated\n", self->count);
@@ -220,7 +229,7 @@ TEST(slab_test, page_boundary_dealloc) {
     test_slab slab(40, 8);
 
     size_t page_offset = slab_page_offset(slab->object_align);
-    ASSERT_EQ(page_offset, 24);
+    ASSERT_EQ(page_offset, 32);
     ASSERT_EQ(slab->slot_size, 80);
     size_t chunks_per_page = (SLAB_PAGE - page_offset) / slab->slot_size;
 
@@ -279,11 +288,11 @@ TEST(slab_test, random_alloc_dealloc_pattern) {
     }
 }
 
-extern "C" void* failing_alloc(void* ctx) {
+extern "C" void* failing_alloc(void* ctx, size_t order) {
     return NULL;
 }
 
-extern "C" void failing_dealloc(void* ctx, void* ptr) {
+extern "C" void failing_dealloc(void* ctx, void* ptr, size_t order) {
     abort();
 }
 
@@ -346,7 +355,7 @@ TEST(slab_test, stress_many_pages) {
     test_slab slab(32, 8);
 
     size_t page_offset = slab_page_offset(slab->object_align);
-    ASSERT_EQ(page_offset, 24);
+    ASSERT_EQ(page_offset, 32);
     ASSERT_EQ(slab->slot_size, 72);
     const size_t chunks_per_page = (SLAB_PAGE - page_offset) / slab->slot_size;
     const size_t total_chunks = chunks_per_page * 50;
@@ -849,3 +858,532 @@ TEST(slab_test, alloc_dealloc_with_multiple_allocators) {
         slab_dealloc(slabs[i]->get(), ptrs[i]);
     }
 }
+
+TEST(slab_release_test, dense_layout) {
+    test_slab slab(32, 8, false, false);
+    ASSERT_EQ(slab->payload_offset, 0);
+    ASSERT_EQ(slab->slot_size, 32);
+
+    test_slab tiny(1, 1, false, false);
+    ASSERT_EQ(tiny->slot_size, 2);
+
+    test_slab odd(20, 4, false, false);
+    ASSERT_EQ(odd->slot_size, 20);
+}
+
+TEST(slab_release_test, alignment) {
+    for (size_t align : { 1, 2, 8, 16, 64, 256 }) {
+        test_slab slab(24, align, false, false);
+        std::vector<void*> ptrs;
+        for (int i = 0; i < 300; i++) {
+            void* ptr = slab_alloc(slab.get());
+            ASSERT_TRUE(ptr);
+            ASSERT_EQ((uintptr_t)ptr % align, 0);
+            ptrs.push_back(ptr);
+        }
+        for (void* ptr : ptrs) {
+            slab_dealloc(slab.get(), ptr);
+        }
+        ASSERT_TRUE(slab.pages.empty());
+    }
+}
+
+TEST(slab_release_test, objects_do_not_overlap) {
+    const size_t size = 40;
+    test_slab slab(size, 8, false, false);
+    std::vector<unsigned char*> ptrs;
+    for (int i = 0; i < 1000; i++) {
+        unsigned char* ptr = (unsigned char*)slab_alloc(slab.get());
+        ASSERT_TRUE(ptr);
+        memset(ptr, i & 0xff, size);
+        ptrs.push_back(ptr);
+    }
+    for (size_t i = 0; i < ptrs.size(); i++) {
+        for (size_t j = 0; j < size; j++) {
+            ASSERT_EQ(ptrs[i][j], i & 0xff);
+        }
+    }
+    for (unsigned char* ptr : ptrs) {
+        slab_dealloc(slab.get(), ptr);
+    }
+    ASSERT_TRUE(slab.pages.empty());
+}
+
+TEST(slab_release_test, more_objects_per_page_than_debug) {
+    test_slab debug(16, 8);
+    test_slab release(16, 8, false, false);
+    ASSERT_LT(release->slot_size, debug->slot_size);
+
+    std::vector<void*> ptrs;
+    for (int i = 0; i < 100; i++) {
+        ptrs.push_back(slab_alloc(release.get()));
+    }
+    ASSERT_EQ(release.pages.size(), 1);
+    for (void* ptr : ptrs) {
+        slab_dealloc(release.get(), ptr);
+    }
+}
+
+TEST(slab_release_test, random_alloc_dealloc_pattern) {
+    test_slab slab(48, 16, false, false);
+    std::vector<void*> ptrs;
+    srand(12345);
+    for (int i = 0; i < 20000; i++) {
+        if (ptrs.empty() || rand() % 3 != 0) {
+            void* ptr = slab_alloc(slab.get());
+            ASSERT_TRUE(ptr);
+            ASSERT_EQ((uintptr_t)ptr % 16, 0);
+            memset(ptr, 0xab, 48);
+            ptrs.push_back(ptr);
+        } else {
+            size_t k = rand() % ptrs.size();
+            slab_dealloc(slab.get(), ptrs[k]);
+            ptrs[k] = ptrs.back();
+            ptrs.pop_back();
+        }
+    }
+    std::sort(ptrs.begin(), ptrs.end());
+    ASSERT_TRUE(std::adjacent_find(ptrs.begin(), ptrs.end()) == ptrs.end());
+    for (void* ptr : ptrs) {
+        slab_dealloc(slab.get(), ptr);
+    }
+    ASSERT_TRUE(slab.pages.empty());
+}
+
+TEST(slab_release_test, zero_sized_type) {
+    test_slab slab(0, 1, false, false);
+    void* a = slab_alloc(slab.get());
+    void* b = slab_alloc(slab.get());
+    ASSERT_TRUE(a && b);
+    ASSERT_NE(a, b);
+    slab_dealloc(slab.get(), a);
+    slab_dealloc(slab.get(), b);
+}
+
+static size_t slots_per_page(test_slab& slab) {
+    return (SLAB_PAGE - slab_page_offset(slab->object_align)) / slab->slot_size;
+}
+
+TEST(slab_page_state_test, empty_page_is_cached) {
+    test_slab slab(64, 8);
+    slab_set_empty_max(slab.get(), 1);
+
+    for (int i = 0; i < 100; i++) {
+        void* ptr = slab_alloc(slab.get());
+        ASSERT_TRUE(ptr);
+        slab_dealloc(slab.get(), ptr);
+    }
+    ASSERT_EQ(slab.count, 1);
+    ASSERT_EQ(slab.pages.size(), 1);
+    ASSERT_EQ(slab->empty_count, 1);
+
+    ASSERT_EQ(slab_shrink(slab.get(), 10), 1);
+    ASSERT_TRUE(slab.pages.empty());
+    ASSERT_EQ(slab->empty_count, 0);
+}
+
+TEST(slab_page_state_test, empty_pages_above_limit_are_freed) {
+    test_slab slab(64, 8);
+    slab_set_empty_max(slab.get(), 2);
+
+    const size_t count = slots_per_page(slab) * 4;
+    std::vector<void*> ptrs;
+    for (size_t i = 0; i < count; i++) {
+        ptrs.push_back(slab_alloc(slab.get()));
+    }
+    ASSERT_GE(slab.pages.size(), 4);
+    for (void* ptr : ptrs) {
+        slab_dealloc(slab.get(), ptr);
+    }
+    ASSERT_EQ(slab.pages.size(), 2);
+    ASSERT_EQ(slab->empty_count, 2);
+
+    slab_set_empty_max(slab.get(), 1);
+    ASSERT_EQ(slab.pages.size(), 1);
+    ASSERT_EQ(slab_shrink(slab.get(), 0), 0);
+    ASSERT_EQ(slab_shrink(slab.get(), 5), 1);
+    ASSERT_TRUE(slab.pages.empty());
+}
+
+TEST(slab_page_state_test, partial_pages_are_preferred) {
+    test_slab slab(64, 8);
+    slab_set_empty_max(slab.get(), 4);
+
+    const size_t per_page = slots_per_page(slab);
+    std::vector<void*> ptrs;
+    for (size_t i = 0; i < per_page * 3; i++) {
+        ptrs.push_back(slab_alloc(slab.get()));
+    }
+    ASSERT_EQ(slab.pages.size(), 3);
+
+    // empty the first page and leave one hole in the second
+    for (size_t i = 0; i <= per_page; i++) {
+        slab_dealloc(slab.get(), ptrs[i]);
+    }
+    ASSERT_EQ(slab->empty_count, 1);
+
+    void* ptr = slab_alloc(slab.get());
+    ASSERT_EQ(ptr, ptrs[per_page]);
+    ASSERT_EQ(slab->empty_count, 1);
+
+    ptr = slab_alloc(slab.get());
+    ASSERT_EQ(slab->empty_count, 0);
+    ASSERT_EQ(slab.count, 3);
+    slab_dealloc(slab.get(), ptr);
+
+    for (size_t i = per_page; i < ptrs.size(); i++) {
+        slab_dealloc(slab.get(), ptrs[i]);
+    }
+    ASSERT_EQ(slab->empty_count, 3);
+    ASSERT_EQ(slab_shrink(slab.get(), SIZE_MAX), 3);
+    ASSERT_TRUE(slab.pages.empty());
+}
+
+TEST(slab_page_state_test, cached_page_keeps_checks) {
+    test_slab slab(32, 8);
+    slab_set_empty_max(slab.get(), 1);
+    void* ptr = slab_alloc(slab.get());
+    slab_dealloc(slab.get(), ptr);
+    ASSERT_DEATH(slab_dealloc(slab.get(), ptr), "");
+    slab_shrink(slab.get(), 1);
+}
+
+TEST(slab_test, owner_from_page_header) {
+    test_slab a(24, 8);
+    test_slab b(100, 4, false, false);
+    std::vector<void*> pa, pb;
+    for (int i = 0; i < 500; i++) {
+        pa.push_back(slab_alloc(a.get()));
+        pb.push_back(slab_alloc(b.get()));
+    }
+    for (int i = 0; i < 500; i++) {
+        ASSERT_EQ(slab_of(pa[i], a->order), a.get());
+        ASSERT_EQ(slab_of(pb[i], b->order), b.get());
+        slab_dealloc(slab_of(pa[i], a->order), pa[i]);
+        slab_dealloc(slab_of(pb[i], b->order), pb[i]);
+    }
+}
+
+static size_t slab_waste(test_slab& slab) {
+    const size_t size = (size_t)SLAB_PAGE << slab->order;
+    const size_t offset = slab_page_offset(slab->object_align);
+    return size - (size - offset) / slab->slot_size * slab->slot_size;
+}
+
+TEST(slab_order_test, small_objects_use_single_pages) {
+    for (size_t size : { 8, 32, 64, 200, 500 }) {
+        test_slab slab(size, 8);
+        ASSERT_EQ(slab->order, 0);
+    }
+}
+
+TEST(slab_order_test, large_objects_keep_waste_low) {
+    for (size_t size : { 1100, 1500, 2048, 2600, 3000 }) {
+        for (bool debug : { true, false }) {
+            test_slab slab(size, 8, false, debug);
+            ASSERT_GT(slab->order, 0);
+            ASSERT_LE(slab_waste(slab) * 100, ((size_t)SLAB_PAGE << slab->order) * SLAB_WASTE_PERCENT);
+        }
+    }
+}
+
+TEST(slab_order_test, alloc_dealloc_across_pages) {
+    test_slab slab(1500, 16);
+    const size_t size = (size_t)SLAB_PAGE << slab->order;
+    const size_t per_page = (size - slab_page_offset(16)) / slab->slot_size;
+    ASSERT_GT(per_page * 1500, SLAB_PAGE);
+
+    std::vector<char*> ptrs;
+    for (size_t i = 0; i < per_page * 3; i++) {
+        char* ptr = (char*)slab_alloc(slab.get());
+        ASSERT_TRUE(ptr);
+        ASSERT_EQ((uintptr_t)ptr % 16, 0);
+        memset(ptr, (int)i, 1500);
+        ptrs.push_back(ptr);
+    }
+    ASSERT_EQ(slab.pages.size(), 3);
+    for (auto [page, i] : slab.pages) {
+        ASSERT_EQ(slab.page_sizes[page], size);
+    }
+    for (size_t i = 0; i < ptrs.size(); i++) {
+        ASSERT_EQ(slab_of(ptrs[i], slab->order), slab.get());
+        ASSERT_TRUE(std::all_of(ptrs[i], ptrs[i] + 1500, [i](char x) { return x == (char)i; }));
+    }
+    for (char* ptr : ptrs) {
+        slab_dealloc(slab.get(), ptr);
+    }
+    ASSERT_TRUE(slab.pages.empty());
+}
+
+TEST(slab_order_test, forced_order) {
+    test_slab slab(64, 8);
+    slab_set_order(slab.get(), 2);
+    std::vector<void*> ptrs;
+    for (int i = 0; i < 1000; i++) {
+        ptrs.push_back(slab_alloc(slab.get()));
+        ASSERT_EQ(slab_of(ptrs.back(), 2), slab.get());
+    }
+    const size_t per_page = (SLAB_PAGE * 4 - slab_page_offset(8)) / slab->slot_size;
+    ASSERT_EQ(slab.pages.size(), (1000 + per_page - 1) / per_page);
+    for (void* ptr : ptrs) {
+        slab_dealloc(slab.get(), ptr);
+    }
+    ASSERT_TRUE(slab.pages.empty());
+}
+
+TEST(slab_color_test, first_objects_cycle_through_colors) {
+    test_slab slab(900, 8, false, false);
+    slab_set_order(slab.get(), 0);
+    ASSERT_GT(slab->color_count, 1);
+    ASSERT_EQ(slab->color_step, 64);
+
+    const size_t offset = slab_page_offset(8);
+    const size_t per_page = (SLAB_PAGE - offset) / slab->slot_size;
+    const size_t page_count = slab->color_count * 2 + 1;
+
+    std::map<uintptr_t, uintptr_t> first;
+    for (size_t i = 0; i < per_page * page_count; i++) {
+        const uintptr_t ptr = (uintptr_t)slab_alloc(slab.get());
+        const uintptr_t page = ptr & ~(uintptr_t)(SLAB_PAGE - 1);
+        ASSERT_LE(ptr + 900, page + SLAB_PAGE);
+        if (first.count(page) == 0 || ptr < first[page]) {
+            first[page] = ptr;
+        }
+    }
+    ASSERT_EQ(first.size(), page_count);
+
+    // pages are colored in allocation order
+    for (size_t i = 0; i < page_count; i++) {
+        const uintptr_t page = (uintptr_t)slab.pages[i].first;
+        ASSERT_EQ(first[page] - page, offset + i % slab->color_count * slab->color_step);
+    }
+    for (auto [page, ptr] : first) {
+        for (size_t j = 0; j < per_page; j++) {
+            slab_dealloc(slab.get(), (void*)(ptr + j * slab->slot_size));
+        }
+    }
+    ASSERT_TRUE(slab.pages.empty());
+}
+
+TEST(slab_color_test, coloring_can_be_disabled) {
+    test_slab slab(900, 8, false, false);
+    slab_set_order(slab.get(), 0);
+    slab_set_coloring(slab.get(), false);
+    ASSERT_EQ(slab->color_count, 1);
+
+    std::vector<void*> ptrs;
+    for (int i = 0; i < 40; i++) {
+        ptrs.push_back(slab_alloc(slab.get()));
+    }
+    for (auto [page, i] : slab.pages) {
+        ASSERT_EQ(std::count(ptrs.begin(), ptrs.end(), (char*)page + slab_page_offset(8)), 1);
+    }
+    for (void* ptr : ptrs) {
+        slab_dealloc(slab.get(), ptr);
+    }
+}
+
+TEST(slab_batch_test, alloc_batch_spans_pages) {
+    for (bool debug : { true, false }) {
+        test_slab slab(48, 16, false, debug);
+        const size_t per_page = slots_per_page(slab);
+        const size_t n = per_page * 3 + 5;
+
+        std::vector<void*> ptrs(n);
+        ASSERT_EQ(slab_alloc_batch(slab.get(), n, ptrs.data()), n);
+        ASSERT_EQ(slab.pages.size(), 4);
+        for (void* ptr : ptrs) {
+            ASSERT_EQ((uintptr_t)ptr % 16, 0);
+            memset(ptr, 0x5a, 48);
+        }
+        std::vector<void*> sorted = ptrs;
+        std::sort(sorted.begin(), sorted.end());
+        ASSERT_TRUE(std::adjacent_find(sorted.begin(), sorted.end()) == sorted.end());
+
+        // the partially used page is reused by a single allocation
+        void* one = slab_alloc(slab.get());
+        ASSERT_EQ(slab.pages.size(), 4);
+        slab_dealloc(slab.get(), one);
+
+        slab_free_batch(slab.get(), n, ptrs.data());
+        ASSERT_TRUE(slab.pages.empty());
+    }
+}
+
+TEST(slab_batch_test, free_batch_mixed_pages) {
+    test_slab slab(64, 8);
+    slab_set_empty_max(slab.get(), 100);
+    // whole pages, so that the freed objects are the only free slots
+    const size_t n = slots_per_page(slab) * 8;
+    std::vector<void*> ptrs;
+    for (size_t i = 0; i < n; i++) {
+        ptrs.push_back(slab_alloc(slab.get()));
+    }
+    std::mt19937 rng(7);
+    std::shuffle(ptrs.begin(), ptrs.end(), rng);
+
+    slab_free_batch(slab.get(), n / 2, ptrs.data());
+    std::vector<void*> again(n / 2);
+    ASSERT_EQ(slab_alloc_batch(slab.get(), n / 2, again.data()), n / 2);
+    std::sort(again.begin(), again.end());
+    std::vector<void*> freed(ptrs.begin(), ptrs.begin() + n / 2);
+    std::sort(freed.begin(), freed.end());
+    ASSERT_EQ(again, freed);
+
+    for (size_t i = n / 2; i < ptrs.size(); i++) {
+        slab_dealloc(slab.get(), ptrs[i]);
+    }
+    slab_free_batch(slab.get(), again.size(), again.data());
+    ASSERT_EQ(slab_shrink(slab.get(), 100), slab.pages.size());
+    ASSERT_TRUE(slab.pages.empty());
+}
+
+TEST(slab_batch_test, alloc_batch_stops_when_out_of_pages) {
+    test_slab slab(64, 8);
+    const size_t per_page = slots_per_page(slab);
+    slab.on_after_alloc = [](test_slab& self) {
+        self.sa.page_allocator.alloc = failing_alloc;
+    };
+    std::vector<void*> ptrs(per_page * 2);
+    ASSERT_EQ(slab_alloc_batch(slab.get(), ptrs.size(), ptrs.data()), per_page);
+    slab_free_batch(slab.get(), per_page, ptrs.data());
+    ASSERT_TRUE(slab.pages.empty());
+}
+
+struct ctor_object {
+    uint64_t magic;
+    uint32_t uses;
+    char name[20];
+};
+
+struct ctor_counts {
+    size_t ctors = 0;
+    size_t dtors = 0;
+};
+
+static void test_ctor(void* obj, void* ctx) {
+    auto o = static_cast<ctor_object*>(obj);
+    o->magic = 0x0123456789abcdef;
+    o->uses = 0;
+    strcpy(o->name, "constructed");
+    static_cast<ctor_counts*>(ctx)->ctors++;
+}
+
+static void test_dtor(void* obj, void* ctx) {
+    auto o = static_cast<ctor_object*>(obj);
+    if (o->magic != 0x0123456789abcdef) {
+        abort();
+    }
+    static_cast<ctor_counts*>(ctx)->dtors++;
+}
+
+TEST(slab_ctor_test, objects_are_constructed_once_per_page) {
+    for (bool debug : { true, false }) {
+        ctor_counts counts;
+        test_slab slab(sizeof(ctor_object), alignof(ctor_object), false, debug);
+        slab_set_ctor(slab.get(), test_ctor, test_dtor, &counts);
+        const size_t per_page = slots_per_page(slab);
+
+        auto o = (ctor_object*)slab_alloc(slab.get());
+        ASSERT_EQ(counts.ctors, per_page);
+        ASSERT_EQ(o->magic, 0x0123456789abcdef);
+        ASSERT_STREQ(o->name, "constructed");
+
+        // a second object keeps the page alive while the first is freed and reused in constructed state
+        auto keep = (ctor_object*)slab_alloc(slab.get());
+        for (int i = 0; i < 100; i++) {
+            o->uses++;
+            slab_dealloc(slab.get(), o);
+            o = (ctor_object*)slab_alloc(slab.get());
+            ASSERT_EQ(o->magic, 0x0123456789abcdef);
+            ASSERT_STREQ(o->name, "constructed");
+        }
+        ASSERT_EQ(o->uses + keep->uses, 100);
+        ASSERT_EQ(counts.ctors, per_page);
+        ASSERT_EQ(counts.dtors, 0);
+
+        slab_dealloc(slab.get(), o);
+        slab_dealloc(slab.get(), keep);
+        ASSERT_TRUE(slab.pages.empty());
+        ASSERT_EQ(counts.dtors, per_page);
+    }
+}
+
+TEST(slab_ctor_test, cached_pages_are_destructed_on_shrink) {
+    ctor_counts counts;
+    test_slab slab(sizeof(ctor_object), alignof(ctor_object), false, false);
+    slab_set_ctor(slab.get(), test_ctor, test_dtor, &counts);
+    slab_set_empty_max(slab.get(), 4);
+
+    const size_t n = slots_per_page(slab) * 3;
+    std::vector<void*> ptrs(n);
+    ASSERT_EQ(slab_alloc_batch(slab.get(), n, ptrs.data()), n);
+    ASSERT_EQ(counts.ctors, n);
+    slab_free_batch(slab.get(), n, ptrs.data());
+    ASSERT_EQ(counts.dtors, 0);
+
+    ASSERT_EQ(slab_alloc_batch(slab.get(), n, ptrs.data()), n);
+    ASSERT_EQ(counts.ctors, n);
+    slab_free_batch(slab.get(), n, ptrs.data());
+
+    ASSERT_EQ(slab_shrink(slab.get(), 10), 3);
+    ASSERT_EQ(counts.dtors, n);
+}
+
+TEST(slab_ctor_test, release_link_does_not_overlap_object) {
+    ctor_counts counts;
+    test_slab slab(sizeof(ctor_object), alignof(ctor_object), false, false);
+    slab_set_ctor(slab.get(), test_ctor, test_dtor, &counts);
+    ASSERT_GE(slab->payload_offset, sizeof(uint16_t));
+    ASSERT_GE(slab->slot_size, slab->payload_offset + sizeof(ctor_object));
+    ASSERT_EQ(slab->payload_offset % alignof(ctor_object), 0);
+}
+
+TEST(slab_ctor_test, debug_still_catches_double_free) {
+    ctor_counts counts;
+    test_slab slab(sizeof(ctor_object), alignof(ctor_object));
+    slab_set_ctor(slab.get(), test_ctor, nullptr, &counts);
+    void* a = slab_alloc(slab.get());
+    void* b = slab_alloc(slab.get());
+    slab_dealloc(slab.get(), a);
+    ASSERT_DEATH(slab_dealloc(slab.get(), a), "");
+    slab_dealloc(slab.get(), b);
+}
+
+TEST(slab_stats_test, counts_pages_by_state) {
+    test_slab slab(100, 8);
+    slab_set_empty_max(slab.get(), 1);
+    const size_t per_page = slots_per_page(slab);
+
+    slab_stats stats;
+    slab_get_stats(slab.get(), &stats);
+    ASSERT_EQ(stats.pages, 0);
+    ASSERT_EQ(stats.objects, 0);
+    ASSERT_EQ(stats.waste, 0);
+
+    std::vector<void*> ptrs(per_page * 3);
+    ASSERT_EQ(slab_alloc_batch(slab.get(), ptrs.size(), ptrs.data()), ptrs.size());
+    // empty the first page and leave the second partial
+    for (size_t i = 0; i <= per_page; i++) {
+        slab_dealloc(slab.get(), ptrs[i]);
+    }
+
+    slab_get_stats(slab.get(), &stats);
+    ASSERT_EQ(stats.object_size, 100);
+    ASSERT_EQ(stats.slot_size, slab->slot_size);
+    ASSERT_EQ(stats.page_size, SLAB_PAGE);
+    ASSERT_EQ(stats.objects, per_page * 2 - 1);
+    ASSERT_EQ(stats.capacity, per_page * 3);
+    ASSERT_EQ(stats.pages, 3);
+    ASSERT_EQ(stats.empty_pages, 1);
+    ASSERT_EQ(stats.partial_pages, 1);
+    ASSERT_EQ(stats.full_pages, 1);
+    ASSERT_EQ(stats.waste, 3 * (SLAB_PAGE - per_page * 100));
+
+    for (size_t i = per_page + 1; i < ptrs.size(); i++) {
+        slab_dealloc(slab.get(), ptrs[i]);
+    }
+    slab_shrink(slab.get(), 1);
+    slab_get_stats(slab.get(), &stats);
+    ASSERT_EQ(stats.pages, 0);
+}